@@ -0,0 +1,298 @@
+///////////////////////////////////////////////////////////////////////
+// Headless benchmark mode;  See bench.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#endif
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "fbo.h"
+#include "scene.h"
+#include "bench.h"
+
+static const float PI = 3.14159f;
+
+struct BenchOptions
+{
+    int frames, warmup;
+    int width, height;
+    int spheres;                // 0 for the scene's default
+    int threads;                // 0 for one per core
+    int samples;                // 0 for no multisampling
+    bool deferred;              // Deferred shading, instead of forward
+    int lights;                 // -1 for the scene's default
+    const char* out;            // NULL for stdout
+};
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& o)
+{
+    o.frames = 300;
+    o.warmup = 10;
+    o.width = 1280;
+    o.height = 720;
+    o.spheres = 0;
+    o.threads = 0;
+    o.samples = 0;
+    o.deferred = false;
+    o.lights = -1;
+    o.out = NULL;
+
+    for (int i=1;  i<argc;  i++) {
+        const char* a = argv[i];
+        const char* v = i+1 < argc ? argv[i+1] : NULL;
+        if (!strcmp(a, "--bench")) continue;
+        if (!v) {
+            fprintf(stderr, "Missing value for %s\n", a);
+            return false; }
+        if (!strcmp(a, "--frames"))       o.frames = atoi(v);
+        else if (!strcmp(a, "--warmup"))  o.warmup = atoi(v);
+        else if (!strcmp(a, "--spheres")) o.spheres = atoi(v);
+        else if (!strcmp(a, "--threads")) o.threads = atoi(v);
+        else if (!strcmp(a, "--samples")) o.samples = atoi(v);
+        else if (!strcmp(a, "--lights"))  o.lights = atoi(v);
+        else if (!strcmp(a, "--out"))     o.out = v;
+        else if (!strcmp(a, "--shader-cache")) ShaderProgram::cacheDirectory = v;
+        else if (!strcmp(a, "--vertices")) {
+            if (strcmp(v, "float") && strcmp(v, "packed")) {
+                fprintf(stderr, "Bad --vertices %s;  Expected float or packed\n", v);
+                return false; }
+            Model::quantizeVertices = !strcmp(v, "packed"); }
+        else if (!strcmp(a, "--shading")) {
+            if (strcmp(v, "forward") && strcmp(v, "deferred")) {
+                fprintf(stderr, "Bad --shading %s;  Expected forward or deferred\n", v);
+                return false; }
+            o.deferred = !strcmp(v, "deferred"); }
+        else if (!strcmp(a, "--size")) {
+            if (sscanf(v, "%dx%d", &o.width, &o.height) != 2) {
+                fprintf(stderr, "Bad --size %s;  Expected WxH\n", v);
+                return false; } }
+        else {
+            fprintf(stderr, "Unknown option %s\n", a);
+            return false; }
+        i++; }
+
+    if (o.frames < 1 || o.warmup < 0 || o.width < 1 || o.height < 1) {
+        fprintf(stderr, "Bad benchmark options\n");
+        return false; }
+    return true;
+}
+
+// Make an OpenGL 3.3 compatibility context current, with no window.
+// Only GLUT (on Windows) needs the command line.
+#ifdef _WIN32
+static bool CreateHeadlessContext(int argc, char** argv)
+{
+    // No EGL here;  Use a window that is never shown.
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+    glutInitContextVersion(3, 3);
+    glutInitContextProfile(GLUT_COMPATIBILITY_PROFILE);
+    glutInitWindowSize(64, 64);
+    glutCreateWindow("Benchmark");
+    glutHideWindow();
+    return true;
+}
+#else
+static bool CreateHeadlessContext(int, char**)
+{
+    // Prefer Mesa's surfaceless platform, which needs no display
+    // server at all.
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)
+        || !eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "EGL initialization failed\n");
+        return false; }
+
+    EGLint attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT_KHR,
+        EGL_NONE };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+    if (context == EGL_NO_CONTEXT
+        || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "No surfaceless OpenGL 3.3 context (EGL error 0x%x)\n",
+                eglGetError());
+        return false; }
+    return true;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// The scripted path, for t from 0 to 1:  One full turn of the camera
+// around the scene while tilting and zooming in and back out, with the
+// light circling the other way and the sphere ring turning.
+static void FollowPath(Scene& scene, const float t)
+{
+    scene.eyeSpin = -150.0f + 360.0f*t;
+    scene.eyeTilt = -60.0f + 15.0f*sin(2.0f*PI*t);
+    scene.zoom = 30.0f - 12.0f*sin(PI*t);
+    scene.lightSpin = -90.0f - 360.0f*t;
+    atime = 360.0f*t;
+}
+
+// Statistics over a list of times, in milliseconds.
+struct Summary { float min, median, p95, p99, mean; };
+
+static Summary Summarize(std::vector<float> ms)
+{
+    Summary s = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    int n = ms.size();
+    if (n == 0) return s;
+    std::sort(ms.begin(), ms.end());
+    float sum = 0.0f;
+    for (int i=0;  i<n;  i++)
+        sum += ms[i];
+    // Nearest rank percentiles
+    s.min = ms[0];
+    s.median = ms[(n-1)/2];
+    s.p95 = ms[std::min(n-1, (int)ceil(0.95*n)-1)];
+    s.p99 = ms[std::min(n-1, (int)ceil(0.99*n)-1)];
+    s.mean = sum/n;
+    return s;
+}
+
+static void WriteSummary(FILE* f, const char* name, const Summary& s, const char* tail)
+{
+    fprintf(f, "  \"%s\": {\"min\": %.3f, \"median\": %.3f, \"p95\": %.3f, "
+            "\"p99\": %.3f, \"mean\": %.3f}%s\n",
+            name, s.min, s.median, s.p95, s.p99, s.mean, tail);
+}
+
+int RunBenchmark(Scene& scene, int argc, char** argv)
+{
+    BenchOptions o;
+    if (!ParseOptions(argc, argv, o))
+        return 2;
+
+    // The JSON goes to --out, or to stdout, which then carries nothing
+    // else:  Whatever the rest of the program prints (mesh statistics,
+    // shader logs, ...) is sent on to stderr.
+    FILE* f = NULL;
+    if (o.out && !(f = fopen(o.out, "w"))) {
+        fprintf(stderr, "Can't write %s\n", o.out);
+        return 1; }
+    if (!f) {
+        fflush(stdout);
+        f = fdopen(dup(fileno(stdout)), "w");
+        dup2(fileno(stderr), fileno(stdout)); }
+    if (!CreateHeadlessContext(argc, argv))
+        return 1;
+    glload::LoadFunctions();
+
+    // An 8 bit color target, like a window's, with multisampling if
+    // asked for.
+    FBO target;
+    unsigned int format = GL_RGBA8;
+    target.Create(o.width, o.height, 1, &format, GL_DEPTH24_STENCIL8, o.samples);
+    target.Bind();
+
+    // Startup time, which the shader binary cache mostly decides
+    typedef std::chrono::high_resolution_clock Clock;
+    scene.width = o.width;
+    scene.height = o.height;
+    Clock::time_point init = Clock::now();
+    InitializeScene(scene);
+    glFinish();
+    float initMs = std::chrono::duration<float, std::milli>(Clock::now()-init).count();
+    if (o.threads > 0)
+        workers.Start(o.threads);
+    if (o.spheres > 0)
+        scene.nSpheres = o.spheres;
+    scene.deferred = o.deferred;
+    if (o.lights >= 0)
+        scene.nPointLights = o.lights;
+
+    // Render the frames.  Each one is waited for (glFinish) so that its
+    // wall time includes the GPU's part.
+    std::vector<float> frameMs, cpuMs, gpuMs;
+    gpuProfiler.enabled = true;
+    int collected = gpuProfiler.collected;
+    int total = o.warmup + o.frames;
+    for (int i=0;  i<=total;  i++) {
+        if (i < total) {
+            FollowPath(scene, i < o.warmup ? 0.0f : float(i-o.warmup)/o.frames);
+
+            Clock::time_point t0 = Clock::now();
+            gpuProfiler.BeginFrame();
+            DrawScene(scene);
+            target.Resolve();
+            Clock::time_point t1 = Clock::now();
+            gpuProfiler.EndFrame();
+            glFinish();
+            Clock::time_point t2 = Clock::now();
+
+            if (i >= o.warmup) {
+                cpuMs.push_back(std::chrono::duration<float, std::milli>(t1-t0).count());
+                frameMs.push_back(std::chrono::duration<float, std::milli>(t2-t0).count()); } }
+        else
+            gpuProfiler.Finish(); // Frames still in flight
+
+        // Gather the GPU times read back since the last frame.
+        const GpuScopeStats& g = gpuProfiler.stats[gpuProfiler.frameScope];
+        for (int c=collected;  c<gpuProfiler.collected;  c++) {
+            int age = gpuProfiler.collected-1-c;
+            gpuMs.push_back(g.history[(gpuProfiler.latest-age+GPU_PROFILER_HISTORY)
+                                      % GPU_PROFILER_HISTORY]); }
+        collected = gpuProfiler.collected; }
+
+    // Warmup frames come first in the GPU times too, unless dropped.
+    if (gpuProfiler.dropped)
+        fprintf(stderr, "Warning: %d frames' GPU times were dropped\n", gpuProfiler.dropped);
+    gpuMs.erase(gpuMs.begin(), gpuMs.begin() + std::min((int)gpuMs.size(), o.warmup));
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"renderer\": \"%s\",\n", glGetString(GL_RENDERER));
+    fprintf(f, "  \"version\": \"%s\",\n", glGetString(GL_VERSION));
+    fprintf(f, "  \"width\": %d, \"height\": %d, \"samples\": %d,\n",
+            o.width, o.height, target.samples);
+    fprintf(f, "  \"shading\": \"%s\", \"lights\": %d, \"vertices\": \"%s\",\n",
+            o.deferred ? "deferred" : "forward", (int)scene.clusters.lights.size(),
+            Model::quantizeVertices ? "packed" : "float");
+    fprintf(f, "  \"init_ms\": %.3f, \"programs_cached\": %d, \"programs_compiled\": %d,\n",
+            initMs, ShaderProgram::cached, ShaderProgram::compiled);
+    fprintf(f, "  \"frames\": %d, \"warmup\": %d, \"spheres\": %d, \"threads\": %d,\n",
+            o.frames, o.warmup, scene.nSpheres, workers.Threads());
+    WriteSummary(f, "frame_ms", Summarize(frameMs), ",");
+    WriteSummary(f, "cpu_ms", Summarize(cpuMs), ",");
+    WriteSummary(f, "gpu_ms", Summarize(gpuMs), ",");
+
+    // Each profiler scope, over its last GPU_PROFILER_HISTORY frames
+    fprintf(f, "  \"gpu_scopes\": {");
+    for (unsigned int s=0;  s<gpuProfiler.seen.size();  s++) {
+        const GpuScopeStats& st = gpuProfiler.stats[gpuProfiler.seen[s]];
+        fprintf(f, "%s\n    \"%s\": {\"mean\": %.3f, \"median\": %.3f, \"p95\": %.3f, "
+                "\"p99\": %.3f}", s ? "," : "", GpuScopeName(gpuProfiler.seen[s]),
+                st.average, st.median, st.p95, st.p99); }
+    fprintf(f, "\n  }\n}\n");
+    fclose(f);
+
+    workers.Stop();
+    return 0;
+}
@@ -0,0 +1,39 @@
+///////////////////////////////////////////////////////////////////////
+// Headless benchmark mode, for repeatable performance measurements on
+// machines with no display (such as CI runners using Mesa's llvmpipe).
+//    framework.exe --bench [--frames N] [--warmup N] [--size WxH]
+//                          [--spheres N] [--threads N] [--lights N] [--samples N]
+//                          [--shading forward|deferred] [--out results.json]
+//                          [--shader-cache DIR] [--vertices float|packed]
+// renders the scene into an offscreen FBO (multisampled with --samples,
+// and resolved every frame), without a window, while a
+// scripted path moves the camera, light and sphere ring over N frames.
+// It then prints the frame time statistics (minimum, median, 95th and
+// 99th percentile, in milliseconds) as JSON:  The whole frame, and its
+// split into CPU time (DrawScene's recording and submission) and GPU
+// time (from the GPU profiler's timer queries), along with the GPU
+// time of each profiler scope, written to --out or else to stdout
+// (everything else printed going to stderr, so that
+//    framework.exe --bench > results.json
+// is valid JSON).  It also reports the startup time
+// (InitializeScene) and how many shader programs came from the binary
+// cache;  --shader-cache "" turns that off, for a cold start.
+// --vertices float stores the models' vertices unpacked, for comparing
+// against the packed (default) ones.
+//
+// The context is an EGL surfaceless one on Linux;  Elsewhere a hidden
+// GLUT window provides it.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _BENCH
+#define _BENCH
+
+class Scene;
+
+// Runs the benchmark on scene, with the program's arguments, and
+// returns the process exit status.
+int RunBenchmark(Scene& scene, int argc, char** argv);
+
+#endif
@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////////
+// Clustered point lights (see lights.h):  The lights reaching a pixel
+// are those listed for its cluster, found from its screen tile and its
+// depth slice.  Include it after framedata.glsl and shading.glsl with
+//    #include "clusters.glsl"
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+uniform samplerBuffer lightData;    // Per light:  Position and radius, color
+uniform usamplerBuffer clusterGrid; // Per cluster:  First index, count
+uniform usamplerBuffer lightIndex;  // The clusters' lists of lights
+
+// The (first, count) range of the lights listed for the cluster
+// holding world position P, drawn at this pixel.
+uvec2 ClusterLights(vec3 P)
+{
+    float depth = -(ViewMatrix*vec4(P, 1.0)).z;
+    int slice = int(floor(log(max(depth, 1e-6))*clusterDepth.x + clusterDepth.y));
+    ivec2 tile = ivec2(gl_FragCoord.xy*vec2(clusterCount.xy)/vec2(WIDTH, HEIGHT));
+    ivec3 c = clamp(ivec3(tile, slice), ivec3(0), clusterCount.xyz - 1);
+    return texelFetch(clusterGrid, (c.z*clusterCount.y + c.y)*clusterCount.x + c.x).xy;
+}
+
+// The light reflected toward E by the point lights, at world position
+// P with unit normal N.  The light falls smoothly to 0 at its radius.
+vec3 PointLights(vec3 P, vec3 N, vec3 E, vec3 Kd, vec3 Ks, float alpha)
+{
+    if (clusterCount.w == 0) return vec3(0.0);
+
+    uvec2 range = ClusterLights(P);
+    vec3 sum = vec3(0.0);
+    for (uint i=0u;  i<range.y;  i++) {
+        int l = int(texelFetch(lightIndex, int(range.x + i)).x);
+        vec4 light = texelFetch(lightData, 2*l);
+        vec3 L = light.xyz - P;
+        float d2 = dot(L, L);
+        float r2 = light.w*light.w;
+        if (d2 >= r2) continue;
+        float falloff = 1.0 - d2/r2;
+        sum += falloff*falloff*texelFetch(lightData, 2*l+1).xyz
+            *Shade(N, L*inversesqrt(d2), E, Kd, Ks, alpha); }
+    return sum;
+}
+
+// A heat map color for the number of lights in P's cluster, from dark
+// blue (none) through yellow (16) to white (32 or more).
+vec3 ClusterHeat(vec3 P)
+{
+    float t = clusterCount.w == 0 ? 0.0 : float(ClusterLights(P).y)/16.0;
+    if (t <= 1.0)
+        return mix(vec3(0.0, 0.0, 0.3), vec3(1.0, 0.9, 0.0), t);
+    return mix(vec3(1.0, 0.9, 0.0), vec3(1.0), min(t-1.0, 1.0));
+}
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////
+// Lightweight CPU instrumentation;  See cputrace.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+#include "cputrace.h"
+
+CpuTrace cpuTrace;
+
+// VS2013 (the project's v120 toolset) predates thread_local.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL thread_local
+#endif
+
+static std::mutex ringMutex;
+static THREAD_LOCAL void* threadRing = NULL;
+static THREAD_LOCAL char threadName[32];
+
+// The calling thread's ring, created on first use.
+CpuTrace::Ring* CpuTrace::ThreadRing()
+{
+    if (threadRing)
+        return (Ring*)threadRing;
+
+    std::lock_guard<std::mutex> lock(ringMutex);
+    int t = threadCount.load();
+    if (t == MAX_TRACE_THREADS)
+        return NULL;
+    Ring* ring = new Ring;
+    ring->count = 0;
+    strcpy(ring->threadName, threadName);
+    rings[t] = ring;
+    threadCount.store(t+1, std::memory_order_release);
+    threadRing = ring;
+    return ring;
+}
+
+void CpuTrace::Record(const char* name, const long long begin, const long long end)
+{
+    Ring* ring = ThreadRing();
+    if (!ring) return;
+    unsigned int n = ring->count.load(std::memory_order_relaxed);
+    TraceEvent& e = ring->events[n & (CPU_TRACE_EVENTS-1)];
+    e.name = name;
+    e.begin = begin;
+    e.end = end;
+    ring->count.store(n+1, std::memory_order_release);
+}
+
+// Name the calling thread in saved traces.
+void CpuTrace::NameThread(const char* name)
+{
+    strncpy(threadName, name, sizeof(threadName)-1);
+    if (threadRing)
+        strcpy(((Ring*)threadRing)->threadName, threadName);
+}
+
+// Write every thread's recorded events (the last CPU_TRACE_EVENTS of
+// each) to a Chrome trace JSON file, as "complete" events with times
+// in microseconds from the earliest.  Returns false if the file can't
+// be written.
+bool CpuTrace::Save(const char* fileName)
+{
+    FILE* f = fopen(fileName, "w");
+    if (!f) {
+        printf("Can't write trace file %s\n", fileName);
+        return false; }
+
+    typedef std::chrono::steady_clock::period Period;
+    const double us = 1.0e6*Period::num/Period::den;
+
+    int threads = threadCount.load(std::memory_order_acquire);
+    long long origin = 0;
+    bool any = false;
+    for (int t=0;  t<threads;  t++) {
+        unsigned int n = rings[t]->count.load(std::memory_order_acquire);
+        unsigned int first = n > (unsigned int)CPU_TRACE_EVENTS ? n-CPU_TRACE_EVENTS : 0;
+        for (unsigned int i=first;  i<n;  i++) {
+            long long b = rings[t]->events[i & (CPU_TRACE_EVENTS-1)].begin;
+            if (!any || b < origin) origin = b;
+            any = true; } }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    const char* sep = "";
+    for (int t=0;  t<threads;  t++) {
+        const Ring& ring = *rings[t];
+        if (ring.threadName[0]) {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}", sep, t, ring.threadName);
+            sep = ",\n"; }
+
+        unsigned int n = ring.count.load(std::memory_order_acquire);
+        unsigned int first = n > (unsigned int)CPU_TRACE_EVENTS ? n-CPU_TRACE_EVENTS : 0;
+        for (unsigned int i=first;  i<n;  i++) {
+            const TraceEvent& e = ring.events[i & (CPU_TRACE_EVENTS-1)];
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f}", sep, e.name, t,
+                    (e.begin-origin)*us, (e.end-e.begin)*us);
+            sep = ",\n"; } }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
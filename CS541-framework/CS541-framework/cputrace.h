@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////
+// Lightweight CPU instrumentation.  A scope is marked by placing
+//    CPU_SCOPE("DrawScene");
+// at the top of a block;  While tracing is on, each execution of the
+// block is recorded as one event (name, start and end time, thread).
+// Method "Save" writes the recorded events as Chrome trace JSON, to be
+// opened in chrome://tracing or ui.perfetto.dev.
+//
+// Each thread records into its own ring buffer of CPU_TRACE_EVENTS
+// events (the newest overwriting the oldest), with no locking:  Only
+// its owner writes to a ring, and it publishes each event by advancing
+// an atomic count.  (A mutex is taken once per thread, when its ring
+// is created by its first event.)  Times come from steady_clock.
+//
+// Tracing is off by default.  A scope then costs one relaxed atomic
+// load and a branch, so the scopes can stay in release builds;
+// Defining NO_CPU_TRACE removes them altogether.
+//
+// Names must be string literals (or otherwise outlive the trace), and
+// Save should be called between frames, when the worker threads are
+// idle, so no ring is being overwritten while it is copied.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _CPUTRACE
+#define _CPUTRACE
+
+#include <atomic>
+#include <chrono>
+
+const int CPU_TRACE_EVENTS = 1<<15;    // Per thread;  A power of two
+const int MAX_TRACE_THREADS = 64;
+
+struct TraceEvent
+{
+    const char* name;
+    long long begin, end;       // steady_clock ticks
+};
+
+class CpuTrace
+{
+public:
+    CpuTrace() :enabled(false), threadCount(0) {}
+
+    std::atomic<bool> enabled;
+
+    bool On() const { return enabled.load(std::memory_order_relaxed); }
+    static long long Now()
+    { return std::chrono::steady_clock::now().time_since_epoch().count(); }
+
+    void Record(const char* name, const long long begin, const long long end);
+    void NameThread(const char* name);
+    bool Save(const char* fileName);
+
+private:
+    struct Ring
+    {
+        std::atomic<unsigned int> count; // Events ever recorded
+        char threadName[32];
+        TraceEvent events[CPU_TRACE_EVENTS];
+    };
+
+    Ring* rings[MAX_TRACE_THREADS];
+    std::atomic<int> threadCount;
+
+    Ring* ThreadRing();
+};
+
+extern CpuTrace cpuTrace;
+
+// Records the enclosing block as one event, if tracing is on when it
+// is entered.
+class CpuScope
+{
+public:
+    CpuScope(const char* n) :name(n), begin(0)
+    { if (cpuTrace.On()) begin = CpuTrace::Now(); }
+    ~CpuScope()
+    { if (begin) cpuTrace.Record(name, begin, CpuTrace::Now()); }
+
+private:
+    const char* name;
+    long long begin;
+};
+
+#ifdef NO_CPU_TRACE
+#define CPU_SCOPE(name)
+#else
+#define CPU_SCOPE_JOIN(a, b) a##b
+#define CPU_SCOPE_VAR(line) CPU_SCOPE_JOIN(cpuScope, line)
+#define CPU_SCOPE(name) CpuScope CPU_SCOPE_VAR(__LINE__)(name)
+#endif
+
+#endif
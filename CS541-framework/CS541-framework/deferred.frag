@@ -0,0 +1,52 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the deferred lighting pass:  Lights each pixel once
+// from the G-buffer (see gbuffer.glsl), whatever the overdraw of the
+// geometry pass.  Its MODE variants match lighting.frag's.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#include "framedata.glsl"
+#include "gbuffer.glsl"
+#include "shading.glsl"
+#include "clusters.glsl"
+
+uniform sampler2D gAlbedo, gNormal, gSpecular, gDepth;
+
+// The view space position of the point with normalized device
+// coordinates ndc, by inverting ProjectionMatrix (a perspective
+// frustum, with only these entries besides -1 in [2][3]).
+vec3 ViewPosition(vec3 ndc)
+{
+    mat4 P = ProjectionMatrix;
+    float z = -P[3][2]/(ndc.z + P[2][2]);
+    return vec3(-z*(ndc.x + P[2][0])/P[0][0], -z*(ndc.y + P[2][1])/P[1][1], z);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).x;
+    if (depth == 1.0) discard;  // Nothing drawn;  Keep the background
+
+    vec3 ndc = 2.0*vec3(gl_FragCoord.xy/vec2(WIDTH, HEIGHT), depth) - 1.0;
+    vec3 world = (ViewInverse*vec4(ViewPosition(ndc), 1.0)).xyz;
+
+    vec3 N = OctDecode(texelFetch(gNormal, pixel, 0).xy);
+    vec3 E = normalize(ViewInverse[3].xyz - world);
+    vec3 L = normalize(lightPos - world);
+
+    vec3 Kd = texelFetch(gAlbedo, pixel, 0).xyz;
+    vec4 specular = texelFetch(gSpecular, pixel, 0);
+
+    float alpha = specular.w*MAX_SHININESS;
+#if MODE == 1
+    gl_FragColor.xyz = 0.5*N + 0.5;
+#elif MODE == 2
+    gl_FragColor.xyz = ClusterHeat(world);
+#else
+    gl_FragColor.xyz = Shade(N, L, E, Kd, specular.xyz, alpha)
+        + PointLights(world, N, E, Kd, specular.xyz, alpha);
+#endif
+}
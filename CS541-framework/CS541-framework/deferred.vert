@@ -0,0 +1,13 @@
+/////////////////////////////////////////////////////////////////////////
+// Vertex shader for the deferred lighting pass:  One triangle covering
+// the whole screen, made from gl_VertexID alone (no vertex buffer).
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(2.0*p - 1.0, 0.0, 1.0);
+}
@@ -1,13 +1,11 @@
 ///////////////////////////////////////////////////////////////////////
 // A slight encapsulation of a Frame Buffer Object (i'e' Render
-// Target) and its associated texture.  When the FBO is "Bound", the
-// output of the graphics pipeline is captured into the texture.  When
-// it is "Unbound", the texture is available for use as any normal
-// texture.
+// Target) and its associated textures.  See fbo.h.
 //
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <fstream>
 
 #include <glload/gl_3_3.h>
@@ -20,48 +18,229 @@
 #include "models.h"
 #include "scene.h"
 
+FBO::FBO()
+    :fbo(0), texture(0), width(0), height(0), samples(0),
+     depthFormat(0), depth(0), resolved(NULL)
+{
+}
+
+FBO::~FBO() { Destroy(); }
+
+// The pixel format and type glTexImage2D wants along with an internal
+// format.  No data is passed, but they must still agree with it.
+static void TransferFormat(const unsigned int internal, GLenum& format, GLenum& type)
+{
+    format = GL_RGBA;
+    type = GL_FLOAT;
+    switch (internal) {
+    case GL_DEPTH_COMPONENT:     case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:   case GL_DEPTH_COMPONENT32:
+    case GL_DEPTH_COMPONENT32F:
+        format = GL_DEPTH_COMPONENT;  break;
+    case GL_DEPTH_STENCIL:       case GL_DEPTH24_STENCIL8:
+        format = GL_DEPTH_STENCIL;  type = GL_UNSIGNED_INT_24_8;  break;
+    case GL_DEPTH32F_STENCIL8:
+        format = GL_DEPTH_STENCIL;  type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;  break;
+
+    case GL_R8I:   case GL_R8UI:   case GL_R16I:  case GL_R16UI:
+    case GL_R32I:  case GL_R32UI:
+        format = GL_RED_INTEGER;  type = GL_INT;  break;
+    case GL_RG8I:  case GL_RG8UI:  case GL_RG16I: case GL_RG16UI:
+    case GL_RG32I: case GL_RG32UI:
+        format = GL_RG_INTEGER;  type = GL_INT;  break;
+    case GL_RGBA8I:  case GL_RGBA8UI:  case GL_RGBA16I:  case GL_RGBA16UI:
+    case GL_RGBA32I: case GL_RGBA32UI: case GL_RGB10_A2UI:
+        format = GL_RGBA_INTEGER;  type = GL_INT;  break;
+    }
+    if (internal == GL_RGB10_A2UI) type = GL_UNSIGNED_INT_2_10_10_10_REV;
+}
+
+static bool HasStencil(const unsigned int internal)
+{
+    return internal == GL_DEPTH_STENCIL || internal == GL_DEPTH24_STENCIL8
+        || internal == GL_DEPTH32F_STENCIL8;
+}
+
+// The original form:  One floating point color texture, and depth.
 void FBO::CreateFBO(const int w, const int h)
 {
+    unsigned int format = GL_RGBA32F;
+    Create(w, h, 1, &format, GL_DEPTH_COMPONENT24);
+}
+
+void FBO::Create(const int w, const int h, const int colorCount,
+                 const unsigned int* colorFormats,
+                 const unsigned int _depthFormat, const int _samples)
+{
+    Destroy();
     width = w;
     height = h;
+    formats.assign(colorFormats, colorFormats+colorCount);
+    depthFormat = _depthFormat;
 
-    glGenFramebuffersEXT(1, &fbo);
-    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
-
-    // Create a render buffer, and attach it to FBO's depth attachment
-    unsigned int depthBuffer;
-    glGenRenderbuffersEXT(1, &depthBuffer);
-    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depthBuffer);
-    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT,
-                             width, height);
-    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT,
-                                 GL_RENDERBUFFER_EXT, depthBuffer);
-
-    // Create texture and attach FBO's color 0 attachment
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, width, height,
-                 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-    glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,
-                              GL_COLOR_ATTACHMENT0_EXT,
-                              GL_TEXTURE_2D, texture, 0);
-
-    // Check for completeness/correctness
-    int status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
-    if (status != GL_FRAMEBUFFER_COMPLETE_EXT)
-        printf("FBO Error: %d\n", status);
+    int maxColors, maxSamples;
+    glGetIntegerv(GL_MAX_COLOR_ATTACHMENTS, &maxColors);
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    if (colorCount > maxColors) {
+        printf("FBO Error: %d color attachments requested;  At most %d allowed\n",
+               colorCount, maxColors);
+        exit(-1); }
+    samples = _samples > 1 ? std::min(_samples, maxSamples) : 0;
+
+    // Create the textures, give them storage, and attach them to the FBO
+    colors.resize(colorCount);
+    if (colorCount)
+        glGenTextures(colorCount, &colors[0]);
+    if (depthFormat)
+        glGenTextures(1, &depth);
+    texture = colorCount ? colors[0] : 0;
+    Allocate();
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    GLenum target = samples ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    std::vector<GLenum> drawBuffers(colorCount);
+    for (int i=0;  i<colorCount;  i++) {
+        drawBuffers[i] = GL_COLOR_ATTACHMENT0+i;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[i], target, colors[i], 0); }
+    if (depthFormat) {
+        GLenum attachment = HasStencil(depthFormat) ? GL_DEPTH_STENCIL_ATTACHMENT
+                                                    : GL_DEPTH_ATTACHMENT;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, target, depth, 0); }
+
+    // Fragment output i goes to color attachment i;  With no colors,
+    // nothing is drawn or read but depth.
+    if (colorCount)
+        glDrawBuffers(colorCount, &drawBuffers[0]);
+    else {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE); }
+    CheckStatus();
 
     // Unbind the fbo.
-    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // A multisampled FBO resolves into a single-sampled one with the
+    // same attachments.
+    if (samples) {
+        resolved = new FBO();
+        resolved->Create(w, h, colorCount, colorFormats, depthFormat, 0); }
+}
+
+// (Re)specify every texture's storage at the current size.  On a
+// resize, the textures stay attached, so the FBO object is untouched.
+void FBO::Allocate()
+{
+    GLenum format, type;
+    for (unsigned int i=0;  i<colors.size()+1;  i++) {
+        unsigned int tex = i < colors.size() ? colors[i] : depth;
+        unsigned int internal = i < colors.size() ? formats[i] : depthFormat;
+        if (!tex) continue;
+
+        if (samples) {
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tex);
+            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, internal,
+                                    width, height, GL_TRUE);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+            continue; }
+
+        TransferFormat(internal, format, type);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // Depth and integer textures can't be filtered.
+        GLenum filter = format != GL_RGBA ? GL_NEAREST : GL_LINEAR;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        if (tex == depth)
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        glBindTexture(GL_TEXTURE_2D, 0); }
 }
 
+// Check the bound FBO for completeness/correctness
+void FBO::CheckStatus()
+{
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("FBO Error: %d\n", status);
+}
+
+void FBO::Resize(const int w, const int h)
+{
+    if (!fbo || (w == width && h == height)) return;
+    width = w;
+    height = h;
+    Allocate();
+
+    GLint previous;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    CheckStatus();
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    if (resolved)
+        resolved->Resize(w, h);
+}
+
+void FBO::Destroy()
+{
+    if (!fbo) return;
+    if (colors.size())
+        glDeleteTextures(colors.size(), &colors[0]);
+    if (depth)
+        glDeleteTextures(1, &depth);
+    glDeleteFramebuffers(1, &fbo);
+    delete resolved;
+
+    fbo = texture = depth = 0;
+    colors.clear();
+    resolved = NULL;
+}
+
+void FBO::Resolve()
+{
+    if (!resolved) return;
+
+    GLint previous;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolved->fbo);
+
+    // A blit copies only one color buffer (the read buffer) at a time.
+    for (unsigned int i=0;  i<colors.size();  i++) {
+        GLenum attachment = GL_COLOR_ATTACHMENT0+i;
+        glReadBuffer(attachment);
+        glDrawBuffers(1, &attachment);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST); }
+    if (depth)
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                          GL_DEPTH_BUFFER_BIT
+                          | (HasStencil(depthFormat) ? GL_STENCIL_BUFFER_BIT : 0),
+                          GL_NEAREST);
+
+    // Restore the draw buffers (of the resolved FBO) and read buffer
+    // (of this one) changed above.
+    if (colors.size()) {
+        std::vector<GLenum> drawBuffers(colors.size());
+        for (unsigned int i=0;  i<colors.size();  i++)
+            drawBuffers[i] = GL_COLOR_ATTACHMENT0+i;
+        glDrawBuffers(drawBuffers.size(), &drawBuffers[0]);
+        glReadBuffer(GL_COLOR_ATTACHMENT0); }
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+unsigned int FBO::Texture(const int i) const
+{
+    return resolved ? resolved->colors[i] : colors[i];
+}
+
+unsigned int FBO::DepthTexture() const
+{
+    return resolved ? resolved->depth : depth;
+}
 
-void FBO::Bind() { glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo); }
-void FBO::Unbind() { glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0); }
+void FBO::Bind() { glBindFramebuffer(GL_FRAMEBUFFER, fbo); }
+void FBO::Unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
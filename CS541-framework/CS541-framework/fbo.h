@@ -1,21 +1,76 @@
 ///////////////////////////////////////////////////////////////////////
 // A slight encapsulation of a Frame Buffer Object (i'e' Render
-// Target) and its associated texture.  When the FBO is "Bound", the
-// output of the graphics pipeline is captured into the texture.  When
-// it is "Unbound", the texture is available for use as any normal
-// texture.
+// Target) and its associated textures.  When the FBO is "Bound", the
+// output of the graphics pipeline is captured into the textures.
+// When it is "Unbound", the textures are available for use as any
+// normal texture.
+//
+// An FBO has any number of color attachments (up to the hardware's
+// limit), each with its own internal format, and optionally a depth
+// (or depth and stencil) texture, all of the same size:
+//    GLenum formats[] = { GL_RGBA8, GL_RGB10_A2, GL_R11F_G11F_B10F };
+//    fbo.Create(w, h, 3, formats, GL_DEPTH24_STENCIL8);
+// Fragment shader output i goes to color attachment i.  The depth
+// texture can be sampled like any other (with comparison mode off).
+//
+// Given a sample count, the attachments are multisample textures
+// instead.  "Resolve" then averages them into single-sampled textures
+// (owned by the FBO, and returned by Texture and DepthTexture) for
+// use as normal textures.  "Resize" gives every attachment new storage
+// of a new size, keeping the same OpenGL objects.
+//
+// The original one-call form, CreateFBO(w, h), still makes a single
+// RGBA32F color texture (member "texture") with a depth attachment.
 //
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
 
+#ifndef _FBO
+#define _FBO
+
+#include <vector>
+
 class FBO {
 public:
+    FBO();
+    ~FBO();
+
     unsigned int fbo;
 
-    unsigned int texture;
-    int width, height;  // Size of the texture.
+    unsigned int texture;       // Color attachment 0's texture
+    int width, height;          // Size of the textures.
+    int samples;                // 0 when not multisampled
+
+    std::vector<unsigned int> formats; // Internal format of each color
+    std::vector<unsigned int> colors;  // Texture of each color attachment
+    unsigned int depthFormat;          // 0 for no depth attachment
+    unsigned int depth;                // Depth texture
 
     void CreateFBO(const int w, const int h);
+    void Create(const int w, const int h, const int colorCount,
+                const unsigned int* colorFormats,
+                const unsigned int depthFormat, const int samples=0);
+    void Resize(const int w, const int h);
+    void Destroy();
     void Bind();
     void Unbind();
+
+    // Multisampled FBOs only:  Average the samples of every attachment
+    // into the single-sampled textures.
+    void Resolve();
+
+    // The textures to sample from:  The attachments themselves, or
+    // their resolved copies if multisampled.
+    unsigned int Texture(const int i) const;
+    unsigned int DepthTexture() const;
+
+private:
+    FBO* resolved;              // Single-sampled twin, if multisampled
+
+    void Allocate();
+    void CheckStatus();
+    FBO(const FBO&);            // Owns OpenGL objects;  Not copyable
+    FBO& operator=(const FBO&);
 };
+
+#endif
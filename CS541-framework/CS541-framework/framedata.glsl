@@ -0,0 +1,27 @@
+/////////////////////////////////////////////////////////////////////////
+// Per-frame camera and light state shared by all shader programs.
+// Include it with
+//    #include "framedata.glsl"
+// The block is filled once per frame from struct FrameData (scene.h),
+// whose layout must match this std140 block member for member.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+layout(std140) uniform FrameData
+{
+    mat4 ProjectionMatrix;
+    mat4 ViewMatrix, ViewInverse;
+    mat4 ViewProjection;        // ProjectionMatrix*ViewMatrix
+
+    vec3 lightPos;      float frameDataPad0;
+    vec3 lightValue;    float frameDataPad1;
+    vec3 lightAmbient;  float frameDataPad2;
+
+    int WIDTH, HEIGHT;
+
+    // Clustered point lights (clusters.glsl):  The grid's size and
+    // number of lights, and slice = log(depth)*x + y.
+    ivec4 clusterCount;
+    vec4 clusterDepth;
+};
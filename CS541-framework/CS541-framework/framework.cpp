@@ -28,10 +28,16 @@
 #include <glm/gtx/std_based_type.hpp>
 
 #include <vector>
+#include <string.h>
 #include "math.h"
 #include "shader.h"
 #include "fbo.h"
 #include "scene.h"
+#include "gpuprofiler.h"
+#include "cputrace.h"
+#include "hud.h"
+#include "bench.h"
+#include "scheduler.h"
 #include "AntTweakBar.h"
 
 using namespace glm;
@@ -41,6 +47,9 @@ static mat4 Identity(1.0f);
 TwBar *bar;
 
 Scene scene;
+FrameGraph graph;
+
+static const int gOverlay = GpuScopeId("Overlay");
 
 // Some globals used for mouse handling.
 int mouseX, mouseY;
@@ -49,12 +58,36 @@ bool middleDown = false;
 bool rightDown = false;
 bool shifted;
 
+////////////////////////////////////////////////////////////////////////
+// Give each GPU profiler scope a row in the Tweaks bar as it is first
+// seen, indented by its nesting depth.
+void AddProfilerRows()
+{
+    static unsigned int shown = 0;
+    for (;  shown<gpuProfiler.seen.size();  shown++) {
+        int s = gpuProfiler.seen[shown];
+        char name[16], def[128];
+        sprintf_s(name, "gpu%d", s);
+        sprintf_s(def, " group='GPU ms: avg p95 p99' label='%*s%s' ",
+                  2*gpuProfiler.stats[s].depth, "", GpuScopeName(s));
+        TwAddVarRO(bar, name, TW_TYPE_CSSTRING(sizeof(gpuProfiler.stats[s].text)),
+                   gpuProfiler.stats[s].text, def); }
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Called by GLUT when the scene needs to be redrawn.
 void ReDraw()
 {
+    CPU_SCOPE("ReDraw");
+    scheduler.Update(StepAnimation);
+    gpuProfiler.BeginFrame();
     DrawScene(scene);
+    gpuProfiler.Begin(gOverlay);
+    graph.Draw(scene.width, scene.height);
     TwDraw();
+    gpuProfiler.End();
+    gpuProfiler.EndFrame();
+    AddProfilerRows();
     glutSwapBuffers();
 }
 
@@ -62,6 +95,7 @@ void ReDraw()
 // Called by GLUT when the window size is changed.
 void ReshapeWindow(int w, int h)
 {
+    CPU_SCOPE("ReshapeWindow");
     if (w && h) {
         glViewport(0, 0, w, h); }
     TwWindowSize(w,h);
@@ -76,6 +110,7 @@ void ReshapeWindow(int w, int h)
 // Called by GLut for keyboard actions.
 void KeyboardDown(unsigned char key, int x, int y)
 {
+    CPU_SCOPE("KeyboardDown");
     if (TwEventKeyboardGLUT(key, x, y)) return;
 
     switch(key) {
@@ -107,6 +142,7 @@ void KeyboardUp(unsigned char key, int x, int y)
 // Called by GLut when a mouse button changes state.
 void MouseButton(int button, int state, int x, int y)
 {
+    CPU_SCOPE("MouseButton");
     if (TwEventMouseButtonGLUT(button, state, x, y)) return;
 
     shifted = glutGetModifiers() && GLUT_ACTIVE_SHIFT;
@@ -143,6 +179,7 @@ void MouseButton(int button, int state, int x, int y)
 // Called by GLut when a mouse moves (while a button is down)
 void MouseMotion(int x, int y)
 {
+    CPU_SCOPE("MouseMotion");
     if (TwEventMouseMotionGLUT(x,y)) return;
 
     int dx = x-mouseX;
@@ -197,21 +234,88 @@ void ToggleSpheres(void *clientData)
     scene.drawSpheres = !scene.drawSpheres;
 }
 
+void ToggleFrontToBack(void *clientData)
+{
+    scene.queue.frontToBack = !scene.queue.frontToBack;
+}
+
+void ToggleCulling(void *clientData)
+{
+    scene.frustumCull = !scene.frustumCull;
+}
+
+void ToggleOcclusion(void *clientData)
+{
+    scene.occlusionCull = !scene.occlusionCull;
+}
+
+void ToggleMeshlets(void *clientData)
+{
+    scene.meshletCull = !scene.meshletCull;
+}
+
+void ToggleLod(void *clientData)
+{
+    scene.useLod = !scene.useLod;
+}
+
+void ToggleMultiDraw(void *clientData)
+{
+    scene.multiDraw = !scene.multiDraw;
+}
+
+void ToggleDeferred(void *clientData)
+{
+    scene.deferred = !scene.deferred;
+}
+
+void ToggleProfiler(void *clientData)
+{
+    gpuProfiler.enabled = !gpuProfiler.enabled;
+}
+
+void ToggleGraph(void *clientData)
+{
+    graph.visible = !graph.visible;
+}
+
+void ToggleTrace(void *clientData)
+{
+    cpuTrace.enabled = !cpuTrace.enabled;
+}
+
+void ToggleAnimation(void *clientData)
+{
+    scheduler.SetAnimating(!scheduler.animating);
+}
+
+void ToggleVsync(void *clientData)
+{
+    scheduler.SetSwapInterval(scheduler.swapInterval ? 0 : 1);
+}
+
+void SaveTrace(void *clientData)
+{
+    if (cpuTrace.Save("trace.json"))
+        printf("CPU trace written to trace.json\n");
+}
+
 void TW_CALL SetModel(const void *value, void *clientData)
 {
+    CPU_SCOPE("SetModel");
     scene.centralModel = *(int*)value; // AntTweakBar forces this cast.
     delete scene.centralPolygons;
     scene.centralPolygons = NULL;
 
     if (scene.centralModel==0) {
-        scene.centralPolygons =  new Teapot(12);    
+        scene.centralPolygons =  new Teapot(12, 3);
         float s = 3.0/scene.centralPolygons->size;
         scene.centralTr =
             scale(Identity, s,s,s)
             *translate(-scene.centralPolygons->center); }
 
     else if (scene.centralModel==1) {
-        scene.centralPolygons = new Ply("bunny.ply");
+        scene.centralPolygons = new Ply("bunny.ply", false, 4);
         float s = 3.0/scene.centralPolygons->size;
         scene.centralTr =
             rotate(Identity, 180.0f, 0.0f, 0.0f, 180.0f)
@@ -220,7 +324,7 @@ void TW_CALL SetModel(const void *value, void *clientData)
             *translate(-scene.centralPolygons->center); }
 
     else if (scene.centralModel==2) {
-        scene.centralPolygons = new Ply("dragon.ply");
+        scene.centralPolygons = new Ply("dragon.ply", false, 4);
         float s = 3.0/scene.centralPolygons->size;
         scene.centralTr =
             rotate(Identity, 180.0f, 0.0f, 0.0f, 180.0f)
@@ -229,8 +333,10 @@ void TW_CALL SetModel(const void *value, void *clientData)
             *translate(-scene.centralPolygons->center); }
 
     else {       // Fallback model
-        scene.centralPolygons = new Sphere(32);
+        scene.centralPolygons = new Sphere(32, 4);
         scene.centralTr = Identity; }
+
+    scene.centralProxy.FromModel(scene.centralPolygons);
 }
 
 void TW_CALL GetModel(void *value, void *clientData)
@@ -242,6 +348,10 @@ void TW_CALL GetModel(void *value, void *clientData)
 // Do the OpenGL/GLut setup and then enter the interactive loop.
 int main(int argc, char** argv)
 {
+    cpuTrace.NameThread("Main");
+    for (int i=1;  i<argc;  i++)
+        if (!strcmp(argv[i], "--bench"))
+            return RunBenchmark(scene, argc, argv);
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitContextVersion (3, 3);
@@ -275,16 +385,59 @@ int main(int argc, char** argv)
     TwGLUTModifiersFunc((int(TW_CALL*)())glutGetModifiers);
 
     bar = TwNewBar("Tweaks");
-    TwDefine(" Tweaks size='200 300' ");
+    TwDefine(" Tweaks size='260 420' valueswidth=120 ");
     TwAddButton(bar, "quit", (TwButtonCallback)Quit, NULL, " label='Quit' key=q ");
 
     TwAddVarCB(bar, "centralModel", TwDefineEnum("CentralModel", NULL, 0),
                SetModel, GetModel, NULL,
                " enum='0 {Teapot}, 1 {Bunny}, 2 {Dragon}, 3 {Sphere}' ");
+    TwAddButton(bar, "Animate", (TwButtonCallback)ToggleAnimation, NULL,
+                " label='Animate' key=SPACE ");
+    TwAddVarRW(bar, "targetRate", TW_TYPE_FLOAT, &scheduler.targetRate,
+               " label='Target FPS' min=0 max=1000 step=5 help='0 for no limit' ");
+    TwAddButton(bar, "Vsync", (TwButtonCallback)ToggleVsync, NULL, " label='Vsync' ");
+    TwAddButton(bar, "Deferred", (TwButtonCallback)ToggleDeferred, NULL,
+                " label='Deferred shading' key=d ");
+    TwAddVarRW(bar, "nPointLights", TW_TYPE_INT32, &scene.nPointLights,
+               " label='Point lights' min=0 max=1024 step=16 ");
+    TwAddVarRO(bar, "assignments", TW_TYPE_INT32, &scene.clusters.assignments,
+               " label='Cluster lights' ");
     TwAddButton(bar, "Spheres", (TwButtonCallback)ToggleSpheres, NULL, " label='Spheres' ");
+    TwAddVarRW(bar, "nSpheres", TW_TYPE_INT32, &scene.nSpheres,
+               " label='Sphere count' min=2 max=256 step=2 ");
+    TwAddButton(bar, "FrontToBack", (TwButtonCallback)ToggleFrontToBack, NULL,
+                " label='Front-to-back' ");
+    TwAddButton(bar, "MultiDraw", (TwButtonCallback)ToggleMultiDraw, NULL,
+                " label='Multi-draw' ");
+    TwAddVarRO(bar, "draws", TW_TYPE_INT32, &scene.queue.draws,
+               " label='Draw calls' ");
+    TwAddButton(bar, "Culling", (TwButtonCallback)ToggleCulling, NULL,
+                " label='Frustum culling' ");
+    TwAddVarRO(bar, "culled", TW_TYPE_INT32, &scene.objectsCulled,
+               " label='Objects culled' ");
+    TwAddButton(bar, "Occlusion", (TwButtonCallback)ToggleOcclusion, NULL,
+                " label='Occlusion culling' ");
+    TwAddVarRO(bar, "occluded", TW_TYPE_INT32, &scene.objectsOccluded,
+               " label='Draws occluded' ");
+    TwAddButton(bar, "Meshlets", (TwButtonCallback)ToggleMeshlets, NULL,
+                " label='Meshlet culling' ");
+    TwAddVarRO(bar, "meshletsCulled", TW_TYPE_INT32, &scene.meshletsCulled,
+               " label='Meshlets culled' ");
+    TwAddButton(bar, "LOD", (TwButtonCallback)ToggleLod, NULL,
+                " label='Levels of detail' ");
     TwAddButton(bar, "Ground", (TwButtonCallback)ToggleGround, NULL, " label='Ground' ");
+    TwAddButton(bar, "Profiler", (TwButtonCallback)ToggleProfiler, NULL,
+                " label='GPU profiler' ");
+    TwAddButton(bar, "Graph", (TwButtonCallback)ToggleGraph, NULL,
+                " label='Frame graph' ");
+    TwAddButton(bar, "Trace", (TwButtonCallback)ToggleTrace, NULL,
+                " label='CPU trace' ");
+    TwAddButton(bar, "SaveTrace", (TwButtonCallback)SaveTrace, NULL,
+                " label='Save CPU trace' ");
 
     InitializeScene(scene);
+    graph.Initialize();
+    scheduler.Start();
 
     // This function enters the event loop.
     glutMainLoop();
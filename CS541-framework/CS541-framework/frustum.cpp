@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////
+// View-frustum culling:  Plane extraction, single box and sphere
+// tests, and SIMD batch tests of bounding spheres.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define FRUSTUM_AVX
+    #define FRUSTUM_SSE
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define FRUSTUM_SSE
+#endif
+
+#include "frustum.h"
+
+////////////////////////////////////////////////////////////////////////
+// Extract the planes from a projection*view matrix (Gribb and
+// Hartmann).  Each plane is a sum or difference of the matrix's fourth
+// row with one of the others.  The planes are then in world space.
+void Frustum::FromMatrix(const mat4& M)
+{
+    vec4 row[4];
+    for (int i=0;  i<4;  i++)
+        row[i] = vec4(M[0][i], M[1][i], M[2][i], M[3][i]);
+
+    planes[0] = row[3] + row[0];  // Left
+    planes[1] = row[3] - row[0];  // Right
+    planes[2] = row[3] + row[1];  // Bottom
+    planes[3] = row[3] - row[1];  // Top
+    planes[4] = row[3] + row[2];  // Near
+    planes[5] = row[3] - row[2];  // Far
+
+    for (int p=0;  p<6;  p++)
+        planes[p] /= length(vec3(planes[p]));
+}
+
+// The same frustum expressed in the coordinates of a transformation
+// tr:  Testing a point p against the result is equivalent to testing
+// tr*p against the original.
+Frustum Frustum::Transformed(const mat4& tr) const
+{
+    Frustum f;
+    mat4 T = transpose(tr);
+    for (int p=0;  p<6;  p++) {
+        f.planes[p] = T*planes[p];
+        f.planes[p] /= length(vec3(f.planes[p])); }
+    return f;
+}
+
+bool Frustum::TestSphere(const vec3& center, const float radius) const
+{
+    for (int p=0;  p<6;  p++)
+        if (dot(vec3(planes[p]), center) + planes[p].w < -radius)
+            return false;
+    return true;
+}
+
+// Test an axis aligned box given by its center and half-extents.  The
+// box is outside a plane if its nearest corner is.
+bool Frustum::TestBox(const vec3& center, const vec3& extent) const
+{
+    for (int p=0;  p<6;  p++) {
+        vec3 n = vec3(planes[p]);
+        float r = dot(abs(n), extent);
+        if (dot(n, center) + planes[p].w < -r)
+            return false; }
+    return true;
+}
+
+// Like TestBox, but also distinguishes boxes entirely inside the
+// frustum (whose contents then need no further tests).
+int Frustum::ClassifyBox(const vec3& center, const vec3& extent) const
+{
+    int result = FRUSTUM_INSIDE;
+    for (int p=0;  p<6;  p++) {
+        vec3 n = vec3(planes[p]);
+        float r = dot(abs(n), extent);
+        float d = dot(n, center) + planes[p].w;
+        if (d < -r)
+            return FRUSTUM_OUTSIDE;
+        if (d < r)
+            result = FRUSTUM_INTERSECTS; }
+    return result;
+}
+
+int Frustum::CullSpheres(const SphereBatch& b, unsigned char* visible) const
+{
+    return CullSpheres(b, 0, b.Size(), visible);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Batch test of spheres.  The plane coefficients are broadcast into
+// SIMD registers once, and each group of 4 (or 8) spheres is then
+// tested against all six planes with no branches.
+int Frustum::CullSpheres(const SphereBatch& batch, const int first, const int n,
+                         unsigned char* visible) const
+{
+    if (n <= 0) return 0;
+
+    // Index the batch from first, so [0,n) covers the requested range.
+    struct { const float *x, *y, *z, *r; } b = {
+        &batch.x[first], &batch.y[first], &batch.z[first], &batch.r[first] };
+    int i = 0;
+    int count = 0;
+
+#ifdef FRUSTUM_AVX
+    {
+        __m256 px[6], py[6], pz[6], pw[6];
+        for (int p=0;  p<6;  p++) {
+            px[p] = _mm256_set1_ps(planes[p].x);
+            py[p] = _mm256_set1_ps(planes[p].y);
+            pz[p] = _mm256_set1_ps(planes[p].z);
+            pw[p] = _mm256_set1_ps(planes[p].w); }
+        const __m256 zero = _mm256_setzero_ps();
+
+        for ( ;  i+8<=n;  i+=8) {
+            __m256 x = _mm256_loadu_ps(&b.x[i]);
+            __m256 y = _mm256_loadu_ps(&b.y[i]);
+            __m256 z = _mm256_loadu_ps(&b.z[i]);
+            __m256 nr = _mm256_sub_ps(zero, _mm256_loadu_ps(&b.r[i]));
+            __m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p=0;  p<6;  p++) {
+                __m256 d = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+                    _mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+                in = _mm256_and_ps(in, _mm256_cmp_ps(d, nr, _CMP_GE_OQ)); }
+            int mask = _mm256_movemask_ps(in);
+            for (int k=0;  k<8;  k++) {
+                visible[i+k] = (mask>>k) & 1;
+                count += visible[i+k]; } }
+    }
+#endif
+
+#ifdef FRUSTUM_SSE
+    {
+        __m128 px[6], py[6], pz[6], pw[6];
+        for (int p=0;  p<6;  p++) {
+            px[p] = _mm_set1_ps(planes[p].x);
+            py[p] = _mm_set1_ps(planes[p].y);
+            pz[p] = _mm_set1_ps(planes[p].z);
+            pw[p] = _mm_set1_ps(planes[p].w); }
+        const __m128 zero = _mm_setzero_ps();
+
+        for ( ;  i+4<=n;  i+=4) {
+            __m128 x = _mm_loadu_ps(&b.x[i]);
+            __m128 y = _mm_loadu_ps(&b.y[i]);
+            __m128 z = _mm_loadu_ps(&b.z[i]);
+            __m128 nr = _mm_sub_ps(zero, _mm_loadu_ps(&b.r[i]));
+            __m128 in = _mm_cmpeq_ps(zero, zero); // All ones
+            for (int p=0;  p<6;  p++) {
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                    _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+                in = _mm_and_ps(in, _mm_cmpge_ps(d, nr)); }
+            int mask = _mm_movemask_ps(in);
+            for (int k=0;  k<4;  k++) {
+                visible[i+k] = (mask>>k) & 1;
+                count += visible[i+k]; } }
+    }
+#endif
+
+    // Scalar remainder (or everything, without SIMD support)
+    for ( ;  i<n;  i++) {
+        visible[i] = TestSphere(vec3(b.x[i], b.y[i], b.z[i]), b.r[i]);
+        count += visible[i]; }
+
+    return count;
+}
@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////
+// View-frustum culling.  A Frustum holds the six clipping planes of a
+// projection*view matrix, and tests bounding boxes and spheres against
+// them.  Large numbers of spheres are tested in batches, stored in
+// structure-of-arrays form (SphereBatch), with SSE (4 at a time) or,
+// when compiled with AVX enabled, AVX (8 at a time).
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _FRUSTUM
+#define _FRUSTUM
+
+#include <vector>
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+// Bounding spheres in structure-of-arrays form for batch testing.
+struct SphereBatch
+{
+    std::vector<float> x, y, z, r;
+
+    void Clear() { x.clear(); y.clear(); z.clear(); r.clear(); }
+    void Add(const vec3& c, const float radius)
+    { x.push_back(c.x); y.push_back(c.y); z.push_back(c.z); r.push_back(radius); }
+    int Size() const { return (int)x.size(); }
+};
+
+enum { FRUSTUM_OUTSIDE=-1, FRUSTUM_INTERSECTS=0, FRUSTUM_INSIDE=1 };
+
+class Frustum
+{
+public:
+    // Planes as (normal, offset) with unit normals pointing inward:
+    // A point p is inside plane P when dot(P.xyz, p) + P.w >= 0.
+    vec4 planes[6];
+
+    void FromMatrix(const mat4& projView);
+    Frustum Transformed(const mat4& tr) const;
+
+    bool TestSphere(const vec3& center, const float radius) const;
+    bool TestBox(const vec3& center, const vec3& extent) const;
+    int ClassifyBox(const vec3& center, const vec3& extent) const;
+
+    // Sets visible[i] to 1 or 0 for each sphere (or for each of the
+    // count spheres starting at first);  Returns the number visible.
+    int CullSpheres(const SphereBatch& batch, unsigned char* visible) const;
+    int CullSpheres(const SphereBatch& batch, const int first, const int count,
+                    unsigned char* visible) const;
+};
+
+#endif
@@ -0,0 +1,37 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the deferred geometry pass:  Writes the surface's
+// material and normal into the G-buffer (see gbuffer.glsl).  It runs
+// after lighting.vert, in place of lighting.frag, and has the same
+// variants.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#include "framedata.glsl"
+#include "gbuffer.glsl"
+
+uniform vec3 phongSpecular;
+uniform float phongShininess;
+
+uniform sampler2D groundColor;
+
+in vec3 normalVec;
+in vec2 texCoord;
+flat in vec3 diffuseColor;
+
+layout(location = 0) out vec4 gAlbedo;
+layout(location = 1) out vec2 gNormal;
+layout(location = 2) out vec4 gSpecular;
+
+void main()
+{
+    vec3 Kd = diffuseColor;
+#if USE_TEXTURE
+    Kd = texture(groundColor,2.0*texCoord.st).xyz;
+#endif
+
+    gAlbedo = vec4(Kd, 1.0);
+    gNormal = OctEncode(normalize(normalVec));
+    gSpecular = vec4(phongSpecular, phongShininess/MAX_SHININESS);
+}
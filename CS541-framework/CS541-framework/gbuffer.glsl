@@ -0,0 +1,40 @@
+/////////////////////////////////////////////////////////////////////////
+// Layout of the G-buffer written by the geometry pass (gbuffer.frag)
+// and read by the deferred lighting pass (deferred.frag), 16 bytes per
+// pixel in all:
+//    0: GL_RGBA8   Diffuse color (albedo) in rgb
+//    1: GL_RG16    World space normal, octahedral encoded
+//    2: GL_RGBA8   Specular color in rgb, shininess/MAX_SHININESS in a
+//    depth:        GL_DEPTH_COMPONENT24, from which the lighting pass
+//                  reconstructs each pixel's position
+// Include it with
+//    #include "gbuffer.glsl"
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+const float MAX_SHININESS = 255.0;
+
+// Octahedral normal encoding:  Project the unit sphere onto the
+// octahedron |x|+|y|+|z| = 1, and unfold the lower half over the
+// corners of the upper half's square, giving a point in [0,1]^2.
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx))*vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return 0.5*e + 0.5;
+}
+
+vec3 OctDecode(vec2 e)
+{
+    e = 2.0*e - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = OctWrap(n.xy);
+    return normalize(n);
+}
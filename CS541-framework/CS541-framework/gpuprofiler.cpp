@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////
+// A GPU frame profiler built on OpenGL timer queries;  See
+// gpuprofiler.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "gpuprofiler.h"
+
+GpuProfiler gpuProfiler;
+
+// The global table of scope names.
+static std::vector<std::string>& ScopeNames()
+{
+    static std::vector<std::string> names;
+    return names;
+}
+
+int GpuScopeId(const char* name)
+{
+    static std::map<std::string, int> ids;
+    std::map<std::string, int>::iterator it = ids.find(name);
+    if (it != ids.end())
+        return it->second;
+    int id = (int)ids.size();
+    if (id >= MAX_GPU_SCOPES) {
+        printf("Too many GPU profiler scopes (at %s)\n", name);
+        exit(-1); }
+    ids[name] = id;
+    ScopeNames().push_back(name);
+    return id;
+}
+
+const char* GpuScopeName(const int id)
+{
+    return ScopeNames()[id].c_str();
+}
+
+int GpuScopeCount()
+{
+    return (int)ScopeNames().size();
+}
+
+GpuProfiler::GpuProfiler()
+    :enabled(true), samples(0), latest(GPU_PROFILER_HISTORY-1), dropped(0),
+     collected(0), current(0), inFrame(false)
+{
+    frameScope = GpuScopeId("Frame");
+    for (int s=0;  s<MAX_GPU_SCOPES;  s++) {
+        GpuScopeStats& st = stats[s];
+        st.depth = -1;
+        std::fill(st.history, st.history+GPU_PROFILER_HISTORY, 0.0f);
+        st.average = st.median = st.p95 = st.p99 = 0.0f;
+        st.text[0] = 0; }
+    for (int f=0;  f<GPU_PROFILER_LATENCY;  f++) {
+        frames[f].used = 0;
+        frames[f].pending = false; }
+}
+
+// Issue a timestamp query from the current frame's pool (growing it as
+// needed) and return its index.
+int GpuProfiler::Timestamp()
+{
+    Frame& frame = frames[current];
+    if (frame.used == (int)frame.queries.size()) {
+        unsigned int q;
+        glGenQueries(1, &q);
+        frame.queries.push_back(q); }
+    glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+    return frame.used++;
+}
+
+// Start recording a frame.  The slot about to be reused holds the
+// frame issued GPU_PROFILER_LATENCY frames ago;  Read it back first.
+void GpuProfiler::BeginFrame()
+{
+    inFrame = enabled;
+    if (!inFrame) return;
+
+    Frame& frame = frames[current];
+    if (frame.pending)
+        Collect(frame);
+    frame.used = 0;
+    frame.intervals.clear();
+    frame.pending = false;
+    stack.clear();
+
+    Begin(frameScope);
+}
+
+void GpuProfiler::EndFrame()
+{
+    if (!inFrame) return;
+    while (!stack.empty())      // Close any scopes left open
+        End();
+    frames[current].pending = true;
+    current = (current+1) % GPU_PROFILER_LATENCY;
+    inFrame = false;
+}
+
+// Wait for the GPU, and read back every frame still pending, oldest
+// first.  For when timings are wanted now rather than in a few frames.
+void GpuProfiler::Finish()
+{
+    glFinish();
+    for (int f=0;  f<GPU_PROFILER_LATENCY;  f++) {
+        Frame& frame = frames[(current+f) % GPU_PROFILER_LATENCY];
+        if (frame.pending)
+            Collect(frame);
+        frame.pending = false; }
+}
+
+void GpuProfiler::Begin(const int scope)
+{
+    if (!inFrame) return;
+    Interval in;
+    in.scope = scope;
+    in.begin = Timestamp();
+    in.end = -1;
+    if (stats[scope].depth < 0) {
+        stats[scope].depth = (int)stack.size();
+        seen.push_back(scope); }
+    stack.push_back((int)frames[current].intervals.size());
+    frames[current].intervals.push_back(in);
+}
+
+void GpuProfiler::End()
+{
+    if (!inFrame || stack.empty()) return;
+    frames[current].intervals[stack.back()].end = Timestamp();
+    stack.pop_back();
+}
+
+// Read back a frame's timestamps, if the GPU has finished with them,
+// and add the frame to the statistics.  Timestamps complete in order,
+// so the last query being ready means all of them are.
+void GpuProfiler::Collect(Frame& frame)
+{
+    if (frame.used == 0) return;
+    GLint ready = 0;
+    glGetQueryObjectiv(frame.queries[frame.used-1], GL_QUERY_RESULT_AVAILABLE, &ready);
+    if (!ready) {
+        dropped++;
+        return; }
+
+    std::vector<GLuint64> times(frame.used);
+    for (int q=0;  q<frame.used;  q++)
+        glGetQueryObjectui64v(frame.queries[q], GL_QUERY_RESULT, &times[q]);
+
+    float ms[MAX_GPU_SCOPES] = {0.0f};
+    for (unsigned int i=0;  i<frame.intervals.size();  i++) {
+        const Interval& in = frame.intervals[i];
+        if (in.end >= 0)
+            ms[in.scope] += (times[in.end] - times[in.begin])*1.0e-6f; }
+
+    latest = (latest+1) % GPU_PROFILER_HISTORY;
+    for (int s=0;  s<MAX_GPU_SCOPES;  s++)
+        stats[s].history[latest] = ms[s];
+    if (samples < GPU_PROFILER_HISTORY)
+        samples++;
+    collected++;
+    Summarize();
+}
+
+// Recompute each seen scope's statistics from its history.
+void GpuProfiler::Summarize()
+{
+    float sorted[GPU_PROFILER_HISTORY];
+    for (unsigned int s=0;  s<seen.size();  s++) {
+        GpuScopeStats& st = stats[seen[s]];
+
+        // The filled part of the ring is its first "samples" entries
+        // until it wraps, and all of it after.
+        float sum = 0.0f;
+        for (int i=0;  i<samples;  i++) {
+            sorted[i] = st.history[i];
+            sum += sorted[i]; }
+        std::sort(sorted, sorted+samples);
+        st.average = sum/samples;
+        st.median = sorted[samples/2];
+        st.p95 = sorted[(samples*95)/100];
+        st.p99 = sorted[(samples*99)/100];
+        sprintf(st.text, "%.2f  %.2f  %.2f", st.average, st.p95, st.p99); }
+}
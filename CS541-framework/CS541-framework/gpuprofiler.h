@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////
+// A GPU frame profiler built on OpenGL timer queries.  Named scopes
+// bracket parts of the frame;  Each scope boundary is a timestamp
+// query (glQueryCounter with GL_TIMESTAMP), and a scope's GPU time is
+// the difference between its two timestamps.  Unlike GL_TIME_ELAPSED
+// queries, which can't overlap, timestamps let scopes nest freely.
+//
+// Scopes are named once, and then referred to by integer id, much as
+// uniforms are (see shader.h):
+//    static int gSpheres = GpuScopeId("Spheres");     // Once
+//    gpuProfiler.Begin(gSpheres);  ...  gpuProfiler.End();
+// or, for a block of code,
+//    { GpuScope scope(gSpheres);  ... }
+// A scope may be entered several times in a frame (as when sorted
+// draws of different objects interleave);  Its time is then the sum.
+//
+// Each frame's queries come from one slot of a ring of
+// GPU_PROFILER_LATENCY slots, and are read back when that slot comes
+// round again, by which time the GPU has long finished with them, so
+// reading never stalls the pipeline.  (Should the GPU still be behind,
+// that frame's timings are dropped rather than waited for.)
+//
+// Usage, each frame, on the OpenGL thread:
+//    gpuProfiler.BeginFrame();
+//    ... scopes ...
+//    gpuProfiler.EndFrame();
+//
+// The results are rolling statistics over the last
+// GPU_PROFILER_HISTORY frames read back:  The average, median, 95th
+// and 99th percentile time of each scope, in milliseconds.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _GPUPROFILER
+#define _GPUPROFILER
+
+#include <vector>
+
+const int GPU_PROFILER_LATENCY = 4;    // Frames between issue and read back
+const int GPU_PROFILER_HISTORY = 128;  // Frames of statistics
+const int MAX_GPU_SCOPES = 32;
+
+// Returns the global id for a scope name, assigning one on first use.
+int GpuScopeId(const char* name);
+const char* GpuScopeName(const int id);
+int GpuScopeCount();
+
+// Statistics for one scope, in milliseconds.
+struct GpuScopeStats
+{
+    int depth;                  // Nesting depth;  -1 until first seen
+    float history[GPU_PROFILER_HISTORY]; // Per frame, a ring
+    float average, median, p95, p99;
+    char text[40];              // The above, formatted for display
+};
+
+class GpuProfiler
+{
+public:
+    GpuProfiler();
+
+    bool enabled;
+    int frameScope;             // The scope spanning each whole frame
+    int samples;                // Frames in each history (up to the max)
+    int latest;                 // Index in history of the newest frame
+    int dropped;                // Frames not ready in time
+    int collected;              // Frames read back in all
+
+    GpuScopeStats stats[MAX_GPU_SCOPES];
+    std::vector<int> seen;      // Scopes in the order first entered
+
+    void BeginFrame();
+    void EndFrame();
+    void Finish();
+    void Begin(const int scope);
+    void End();
+
+    // The newest frame's time for a scope, in milliseconds.
+    float Latest(const int scope) const { return stats[scope].history[latest]; }
+
+private:
+    // A scope entered in a frame, and its two queries' indices.
+    struct Interval { int scope, begin, end; };
+
+    struct Frame
+    {
+        std::vector<unsigned int> queries;
+        int used;               // Queries issued this frame
+        std::vector<Interval> intervals;
+        bool pending;           // Issued but not yet read back
+    };
+
+    Frame frames[GPU_PROFILER_LATENCY];
+    int current;                // Slot being recorded
+    bool inFrame;
+    std::vector<int> stack;     // Open intervals
+
+    int Timestamp();
+    void Collect(Frame& frame);
+    void Summarize();
+};
+
+extern GpuProfiler gpuProfiler;
+
+// Times the enclosing block as a scope.
+class GpuScope
+{
+public:
+    GpuScope(const int scope) { gpuProfiler.Begin(scope); }
+    ~GpuScope() { gpuProfiler.End(); }
+};
+
+#endif
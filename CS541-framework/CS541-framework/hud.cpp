@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////
+// An on-screen frame-time graph;  See hud.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <stdio.h>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <glutil/Font.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "hud.h"
+
+// Placement of the graph, in pixels from the window's lower left.
+static const float GRAPH_X = 10.0f, GRAPH_Y = 10.0f;
+static const float GRAPH_WIDTH = 2.0f*GPU_PROFILER_HISTORY, GRAPH_HEIGHT = 80.0f;
+
+static const int uHudProjection = UniformId("hudProjection");
+static const int uHudColor = UniformId("hudColor");
+static const int uHudText = UniformId("hudText");
+static const int uHudFont = UniformId("hudFont");
+
+FrameGraph::FrameGraph()
+    :visible(true), font(NULL), vao(0), buffer(0), latest(GPU_PROFILER_HISTORY-1),
+     samples(0)
+{
+    std::fill(intervals, intervals+GPU_PROFILER_HISTORY, 0.0f);
+}
+
+FrameGraph::~FrameGraph()
+{
+    delete font;
+}
+
+void FrameGraph::Initialize()
+{
+    font = glutil::GenerateFont(glutil::FONT_SIZE_MEDIUM);
+
+    shader.CreateProgram();
+    shader.CreateShader("hud.vert", GL_VERTEX_SHADER);
+    shader.CreateShader("hud.frag", GL_FRAGMENT_SHADER);
+    shader.BindAttribute(0, "hudVertex");
+    shader.LinkProgram();
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    last = std::chrono::high_resolution_clock::now();
+}
+
+// Append the glyphs of a line of text, with its baseline at pos.
+void FrameGraph::Text(const char* s, const vec2& pos)
+{
+    std::vector<glutil::GlyphQuad> glyphs = font->LayoutLine(s, pos);
+    for (unsigned int g=0;  g<glyphs.size();  g++) {
+        std::vector<vec2> p = glyphs[g].GetPositions();
+        std::vector<vec2> t = glyphs[g].GetTexCoords();
+        // Two triangles from the strip order (TL, BL, TR, BR).
+        const int corner[6] = {0, 1, 2, 2, 1, 3};
+        for (int c=0;  c<6;  c++)
+            verts.push_back(vec4(p[corner[c]], t[corner[c]])); }
+}
+
+// Draw the vertices collected so far, and start afresh.
+void FrameGraph::Emit(const unsigned int mode, const vec4& color, const bool text)
+{
+    if (verts.empty()) return;
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vec4)*verts.size(), &verts[0][0],
+                 GL_STREAM_DRAW);
+    shader.SetUniform(uHudColor, color);
+    shader.SetUniform(uHudText, text ? 1 : 0);
+    glDrawArrays(mode, 0, verts.size());
+    verts.clear();
+}
+
+void FrameGraph::Draw(const int width, const int height)
+{
+    // Time since the last call, drawn or not.
+    std::chrono::high_resolution_clock::time_point now =
+        std::chrono::high_resolution_clock::now();
+    latest = (latest+1) % GPU_PROFILER_HISTORY;
+    intervals[latest] = std::chrono::duration<float, std::milli>(now-last).count();
+    last = now;
+    if (samples < GPU_PROFILER_HISTORY)
+        samples++;
+
+    if (!visible || !font || width <= 0 || height <= 0) return;
+
+    // The vertical scale:  30Hz, or double that until everything fits.
+    const GpuProfiler& p = gpuProfiler;
+    const GpuScopeStats& gpu = p.stats[p.frameScope];
+    float top = 1000.0f/30.0f;
+    for (int i=0;  i<GPU_PROFILER_HISTORY;  i++)
+        while (max(intervals[i], gpu.history[i]) > top && top < 1000.0f)
+            top *= 2.0f;
+    const float dx = GRAPH_WIDTH/GPU_PROFILER_HISTORY;
+    const float dy = GRAPH_HEIGHT/top;
+
+    shader.Use();
+    shader.SetUniform(uHudProjection, ortho(0.0f, float(width), 0.0f, float(height)));
+    shader.SetUniform(uHudFont, 0);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Backdrop
+    const float x0 = GRAPH_X, y0 = GRAPH_Y, x1 = x0+GRAPH_WIDTH, y1 = y0+GRAPH_HEIGHT;
+    const float fh = (float)font->GetLinePixelHeight();
+    verts.push_back(vec4(x0-4, y0-4, 0, 0));
+    verts.push_back(vec4(x1+4, y0-4, 0, 0));
+    verts.push_back(vec4(x0-4, y1+2*fh+4, 0, 0));
+    verts.push_back(vec4(x1+4, y1+2*fh+4, 0, 0));
+    Emit(GL_TRIANGLE_STRIP, vec4(0.0f, 0.0f, 0.0f, 0.6f), false);
+
+    // Reference lines at 60Hz and 30Hz
+    for (int r=1;  r<=2;  r++) {
+        float y = y0 + dy*r*1000.0f/60.0f;
+        verts.push_back(vec4(x0, y, 0, 0));
+        verts.push_back(vec4(x1, y, 0, 0)); }
+    Emit(GL_LINES, vec4(0.5f, 0.5f, 0.5f, 1.0f), false);
+
+    // Oldest frame at the left
+    for (int i=0;  i<samples;  i++) {
+        int h = (latest+1+GPU_PROFILER_HISTORY-samples+i) % GPU_PROFILER_HISTORY;
+        verts.push_back(vec4(x1 - dx*(samples-1-i), y0 + dy*intervals[h], 0, 0)); }
+    Emit(GL_LINE_STRIP, vec4(1.0f, 1.0f, 0.3f, 1.0f), false);
+
+    for (int i=0;  i<p.samples;  i++) {
+        int h = (p.latest+1+GPU_PROFILER_HISTORY-p.samples+i) % GPU_PROFILER_HISTORY;
+        verts.push_back(vec4(x1 - dx*(p.samples-1-i), y0 + dy*gpu.history[h], 0, 0)); }
+    Emit(GL_LINE_STRIP, vec4(0.3f, 1.0f, 0.3f, 1.0f), false);
+
+    // Legend, in the line colors
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, font->GetTexture());
+    char line[64];
+    sprintf(line, "frame %5.1f ms", intervals[latest]);
+    Text(line, vec2(x0, y1+fh+4));
+    Emit(GL_TRIANGLES, vec4(1.0f, 1.0f, 0.3f, 1.0f), true);
+    sprintf(line, "GPU %5.2f ms", p.samples ? p.Latest(p.frameScope) : 0.0f);
+    Text(line, vec2(x0 + 16*font->GetGlyphAdvanceWidth(), y1+fh+4));
+    Emit(GL_TRIANGLES, vec4(0.3f, 1.0f, 0.3f, 1.0f), true);
+    sprintf(line, "top %.0f ms", top);
+    Text(line, vec2(x0, y1+4));
+    Emit(GL_TRIANGLES, vec4(0.8f, 0.8f, 0.8f, 1.0f), true);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    shader.Unuse();
+}
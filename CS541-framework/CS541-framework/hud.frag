@@ -0,0 +1,18 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the on-screen overlay (hud.cpp)
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform vec4 hudColor;
+uniform bool hudText;           // Modulate by the font texture?
+uniform sampler2D hudFont;      // Glyph coverage in the red channel
+
+in vec2 hudTexCoord;
+
+void main()
+{
+    float a = hudText ? texture(hudFont, hudTexCoord).r : 1.0;
+    gl_FragColor = vec4(hudColor.rgb, hudColor.a*a);
+}
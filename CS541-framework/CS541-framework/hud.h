@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////
+// An on-screen frame-time graph, drawn over the finished frame.  It
+// plots the last GPU_PROFILER_HISTORY frames' GPU time (the profiler's
+// frame scope, see gpuprofiler.h) and the interval between frames as
+// seen by the CPU, against reference lines at 60Hz and 30Hz, with the
+// latest values as text in glutil's bitmap font.
+//
+// Usage:
+//    graph.Initialize();                 // Once, with a context
+//    graph.Draw(width, height);          // Each frame, before TwDraw
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _HUD
+#define _HUD
+
+#include <vector>
+#include <chrono>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "gpuprofiler.h"
+
+namespace glutil { class Font; }
+
+using namespace glm;
+
+class FrameGraph
+{
+public:
+    FrameGraph();
+    ~FrameGraph();
+
+    bool visible;
+
+    void Initialize();
+    void Draw(const int width, const int height);
+
+private:
+    glutil::Font* font;
+    ShaderProgram shader;
+    unsigned int vao, buffer;
+    std::vector<vec4> verts;    // Pixel position and texture coordinate
+
+    // Frame intervals measured here, in milliseconds.
+    std::chrono::high_resolution_clock::time_point last;
+    float intervals[GPU_PROFILER_HISTORY];
+    int latest, samples;
+
+    void Text(const char* s, const vec2& pos);
+    void Emit(const unsigned int mode, const vec4& color, const bool text);
+};
+
+#endif
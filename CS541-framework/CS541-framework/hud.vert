@@ -0,0 +1,17 @@
+/////////////////////////////////////////////////////////////////////////
+// Vertex shader for the on-screen overlay (hud.cpp)
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform mat4 hudProjection;     // Window pixels to clip coordinates
+
+in vec4 hudVertex;              // Pixel position in xy, texture in zw
+out vec2 hudTexCoord;
+
+void main()
+{
+    gl_Position = hudProjection*vec4(hudVertex.xy, 0.0, 1.0);
+    hudTexCoord = hudVertex.zw;
+}
@@ -1,23 +1,25 @@
 /////////////////////////////////////////////////////////////////////////
-// Pixel shader for the final pass
+// Pixel shader for the final pass.  Compiled in variants (see
+// shader.h) by USE_TEXTURE (the ground's texture for the diffuse
+// color) and MODE (keys '0'-'9':  1 shows normals, 2 the number of
+// point lights in each cluster, and others the lit scene).
 //
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
 #version 330
 
-uniform int mode;
-uniform bool useTexture;
+#include "framedata.glsl"
+#include "shading.glsl"
+#include "clusters.glsl"
 
-uniform vec3 phongDiffuse;
 uniform vec3 phongSpecular;
 uniform float phongShininess;
 
-uniform vec3 lightValue, lightAmbient;
-
 uniform sampler2D groundColor;
 
 in vec3 normalVec, lightVec, eyeVec;
 in vec2 texCoord;
+flat in vec3 diffuseColor;
 
 void main()
 {
@@ -25,11 +27,18 @@ void main()
     vec3 E = normalize(eyeVec);   
     vec3 L = normalize(lightVec);
 
-    vec3 Kd = phongDiffuse;
-    if (useTexture)
-        Kd = texture(groundColor,2.0*texCoord.st).xyz;
-
-    gl_FragColor.xyz = max(0.0, dot(L, N))*Kd;
-
-
+    vec3 Kd = diffuseColor;
+#if USE_TEXTURE
+    Kd = texture(groundColor,2.0*texCoord.st).xyz;
+#endif
+
+    vec3 P = ViewInverse[3].xyz - eyeVec;   // World position
+#if MODE == 1
+    gl_FragColor.xyz = 0.5*N + 0.5;         // Normals
+#elif MODE == 2
+    gl_FragColor.xyz = ClusterHeat(P);      // Point lights per cluster
+#else
+    gl_FragColor.xyz = Shade(N, L, E, Kd, phongSpecular, phongShininess)
+        + PointLights(P, N, E, Kd, phongSpecular, phongShininess);
+#endif
 }
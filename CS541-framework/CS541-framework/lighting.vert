@@ -4,23 +4,50 @@
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
 #version 330
+#ifdef GL_ARB_shader_draw_parameters
+#extension GL_ARB_shader_draw_parameters : enable
+#endif
+
+#include "framedata.glsl"
 
 void PhongVS();
 
 uniform mat4 ModelMatrix;
-uniform mat4 ViewMatrix, ViewInverse;
-uniform mat4 ProjectionMatrix;
 uniform mat4 NormalMatrix;
 
-uniform vec3 lightPos;
+uniform vec3 phongDiffuse;
+
+// When instanced, each instance is further transformed by its own
+// matrices (after ModelMatrix) and supplies its own diffuse color.
+uniform bool instanced;
+
+// Packed positions (see vertexbuffer.h) are relative to the model's
+// bounds:  vertex.xyz*positionDecode.w + positionDecode.xyz.  Unpacked
+// ones come with (0,0,0,1).
+uniform vec4 positionDecode;
+
+// In multi-draw mode (see RenderQueue) the per-draw values above come
+// instead from a buffer texture of DRAW_DATA_TEXELS texels per draw,
+// indexed by drawBase plus the draw's index within the multi-draw:
+// ModelMatrix (4 columns), NormalMatrix (3 columns), phongDiffuse
+// with the instanced flag in w, and positionDecode.
+uniform bool multiDraw;
+uniform int drawBase;
+uniform samplerBuffer drawData;
+const int DRAW_DATA_TEXELS = 9;
 
 in vec4 vertex;
 in vec3 vertexNormal;
 in vec2 vertexTexture;
 in vec3 vertexTangent;
 
+in mat4 instanceModel;
+in mat3 instanceNormal;
+in vec3 instanceDiffuse;
+
 out vec3 tangent;
 out vec2 texCoord;
+flat out vec3 diffuseColor;
 
 out vec3 normalVec, lightVec, eyeVec;
 
@@ -29,11 +56,33 @@ void main()
     tangent = vertexTangent;
     texCoord = vertexTexture;
 
-    normalVec = normalize(mat3(NormalMatrix)*vertexNormal);    
+    mat4 M = ModelMatrix;
+    mat3 N = mat3(NormalMatrix);
+    diffuseColor = phongDiffuse;
+    bool inst = instanced;
+    vec4 decode = positionDecode;
+#ifdef GL_ARB_shader_draw_parameters
+    if (multiDraw) {
+        int d = DRAW_DATA_TEXELS*(drawBase + gl_DrawIDARB);
+        M = mat4(texelFetch(drawData, d), texelFetch(drawData, d+1),
+                 texelFetch(drawData, d+2), texelFetch(drawData, d+3));
+        N = mat3(texelFetch(drawData, d+4).xyz, texelFetch(drawData, d+5).xyz,
+                 texelFetch(drawData, d+6).xyz);
+        vec4 Kd = texelFetch(drawData, d+7);
+        diffuseColor = Kd.xyz;
+        inst = Kd.w != 0.0;
+        decode = texelFetch(drawData, d+8); }
+#endif
+    if (inst) {
+        M = M*instanceModel;
+        N = N*instanceNormal;
+        diffuseColor = instanceDiffuse; }
+
+    normalVec = normalize(N*vertexNormal);    
     
-    vec3 worldVertex = vec3(ModelMatrix * vertex);
-    eyeVec = (ViewInverse*vec4(0,0,0,1)).xyz - worldVertex;
-    lightVec = lightPos - worldVertex;
+    vec4 worldVertex = M*vec4(vertex.xyz*decode.w + decode.xyz, 1.0);
+    eyeVec = ViewInverse[3].xyz - worldVertex.xyz;
+    lightVec = lightPos - worldVertex.xyz;
 
-    gl_Position = ProjectionMatrix*ViewMatrix*ModelMatrix*vertex;
+    gl_Position = ViewProjection*worldVertex;
 }
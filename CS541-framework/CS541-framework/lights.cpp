@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////
+// Clustered light culling:  Cluster boxes, the per-slice light
+// assignment jobs, and the buffer textures.  See lights.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define LIGHTS_SSE
+#endif
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "shader.h"
+#include "lights.h"
+#include "workers.h"
+#include "cputrace.h"
+
+static const int uLightData = UniformId("lightData");
+static const int uClusterGrid = UniformId("clusterGrid");
+static const int uLightIndex = UniformId("lightIndex");
+
+// Index of the lowest set bit of a non-zero word
+static inline int LowestBit(const ::uint64_t w)
+{
+#ifdef _MSC_VER
+    unsigned long b;
+    _BitScanForward64(&b, w);
+    return (int)b;
+#else
+    return __builtin_ctzll(w);
+#endif
+}
+
+LightClusters::LightClusters()
+    :assignments(0), boxProjection(0.0f), boxFront(0.0f)
+{
+    buffers[0] = buffers[1] = buffers[2] = 0;
+}
+
+ivec4 LightClusters::Counts() const
+{
+    return ivec4(CLUSTER_X, CLUSTER_Y, CLUSTER_Z, (int)lights.size());
+}
+
+vec4 LightClusters::DepthParams() const
+{
+    float scale = CLUSTER_Z/log(CLUSTER_FAR/CLUSTER_NEAR);
+    return vec4(scale, -log(CLUSTER_NEAR)*scale, 0.0f, 0.0f);
+}
+
+////////////////////////////////////////////////////////////////////////
+// The view space box of every cluster.  A tile's sides are planes
+// through the eye, so within a slice its x (and y) range is found at
+// the slice's near or far depth.  These only change with the
+// projection.
+void LightClusters::BuildBoxes(const mat4& P, const float front)
+{
+    vec4 depth = DepthParams();
+    for (int k=0;  k<CLUSTER_Z;  k++) {
+        Slice& s = slices[k];
+        s.zmin = k == 0 ? front : exp((k-depth.y)/depth.x);
+        s.zmax = k == CLUSTER_Z-1 ? 1e6f : exp((k+1-depth.y)/depth.x);
+
+        // At distance d, the point with NDC x is at view x = d*(x + P[2][0])/P[0][0]
+        for (int i=0;  i<CLUSTER_X;  i++) {
+            float a = (-1.0f + 2.0f*i/CLUSTER_X + P[2][0])/P[0][0];
+            float b = (-1.0f + 2.0f*(i+1)/CLUSTER_X + P[2][0])/P[0][0];
+            s.xmin[i] = std::min(a*s.zmin, a*s.zmax);
+            s.xmax[i] = std::max(b*s.zmin, b*s.zmax); }
+        for (int j=0;  j<CLUSTER_Y;  j++) {
+            float a = (-1.0f + 2.0f*j/CLUSTER_Y + P[2][1])/P[1][1];
+            float b = (-1.0f + 2.0f*(j+1)/CLUSTER_Y + P[2][1])/P[1][1];
+            s.ymin[j] = std::min(a*s.zmin, a*s.zmax);
+            s.ymax[j] = std::max(b*s.zmin, b*s.zmax); } }
+
+    boxProjection = P;
+    boxFront = front;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Assign lights to the clusters of depth slice k, building its light
+// lists.
+void LightClusters::AssignSlice(const int k)
+{
+    CPU_SCOPE("AssignSlice");
+    Slice& s = slices[k];
+    const mat4& P = projection;
+    int words = (viewLights.size()+63)/64;
+    s.bits.assign(CLUSTER_TILES*words, 0);
+
+    for (unsigned int l=0;  l<viewLights.size();  l++) {
+        vec3 c = vec3(viewLights[l]);
+        float r = viewLights[l].w;
+        float d = -c.z;
+
+        // Distance to the slice in depth
+        float dz = std::max(0.0f, std::max(s.zmin-d, d-s.zmax));
+        float rest = r*r - dz*dz;
+        if (rest < 0.0f) continue;
+
+        // The columns and rows the sphere's bounding box can reach
+        // within the slice, from its NDC extent at the nearest and
+        // farthest depths of that part of the slice.
+        float d0 = std::max(std::max(s.zmin, d-r), 1e-3f);
+        float d1 = std::min(s.zmax, d+r);
+        float nx0 = std::min((c.x-r)/d0, (c.x-r)/d1)*P[0][0] - P[2][0];
+        float nx1 = std::max((c.x+r)/d0, (c.x+r)/d1)*P[0][0] - P[2][0];
+        float ny0 = std::min((c.y-r)/d0, (c.y-r)/d1)*P[1][1] - P[2][1];
+        float ny1 = std::max((c.y+r)/d0, (c.y+r)/d1)*P[1][1] - P[2][1];
+        int i0 = std::max(0, (int)floor((nx0+1.0f)*0.5f*CLUSTER_X));
+        int i1 = std::min(CLUSTER_X-1, (int)floor((nx1+1.0f)*0.5f*CLUSTER_X));
+        int j0 = std::max(0, (int)floor((ny0+1.0f)*0.5f*CLUSTER_Y));
+        int j1 = std::min(CLUSTER_Y-1, (int)floor((ny1+1.0f)*0.5f*CLUSTER_Y));
+        if (i0 > i1 || j0 > j1) continue;
+
+        ::uint64_t bit = ::uint64_t(1) << (l%64);
+        int word = l/64;
+        for (int j=j0;  j<=j1;  j++) {
+            float dy = std::max(0.0f, std::max(s.ymin[j]-c.y, c.y-s.ymax[j]));
+            float rowRest = rest - dy*dy;
+            if (rowRest < 0.0f) continue;
+            ::uint64_t* row = &s.bits[(j*CLUSTER_X)*words + word];
+
+            // The exact sphere-box test, on whole groups of four
+            // columns:  Columns outside [i0, i1] fail it anyway.
+            int i = i0 & ~3;
+#ifdef LIGHTS_SSE
+            const __m128 cx = _mm_set1_ps(c.x);
+            const __m128 limit = _mm_set1_ps(rowRest);
+            const __m128 zero = _mm_setzero_ps();
+            for ( ;  i<=i1;  i+=4) {
+                __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&s.xmin[i]), cx),
+                                                        _mm_sub_ps(cx, _mm_loadu_ps(&s.xmax[i]))));
+                int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), limit));
+                for (int n=0;  n<4;  n++)
+                    if (mask & (1<<n))
+                        row[(i+n)*words] |= bit; }
+#endif
+            for ( ;  i<=i1;  i++) {
+                float dx = std::max(0.0f, std::max(s.xmin[i]-c.x, c.x-s.xmax[i]));
+                if (dx*dx <= rowRest)
+                    row[i*words] |= bit; } } }
+
+    // Turn each tile's bits into its list, in light order.
+    s.indices.clear();
+    for (int t=0;  t<CLUSTER_TILES;  t++) {
+        s.first[t] = s.indices.size();
+        for (int w=0;  w<words;  w++)
+            for (::uint64_t b = s.bits[t*words+w];  b;  b &= b-1)
+                s.indices.push_back(w*64 + LowestBit(b));
+        s.count[t] = s.indices.size() - s.first[t]; }
+}
+
+void LightClusters::AssignJob(int index, int, void* data)
+{
+    ((LightClusters*)data)->AssignSlice(index);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Assign this frame's lights to the clusters of the frustum given by
+// view, projection (a perspective frustum) and its near distance.
+void LightClusters::Build(const mat4& view, const mat4& P, const float front)
+{
+    CPU_SCOPE("LightClusters::Build");
+    if (lights.size() > (unsigned int)MAX_POINT_LIGHTS)
+        lights.resize(MAX_POINT_LIGHTS);
+    if (P != boxProjection || front != boxFront)
+        BuildBoxes(P, front);
+    projection = P;
+
+    viewLights.resize(lights.size());
+    for (unsigned int l=0;  l<lights.size();  l++)
+        viewLights[l] = vec4(vec3(view*vec4(lights[l].position, 1.0f)), lights[l].radius);
+
+    grid.resize(2*CLUSTER_COUNT);
+    indices.clear();
+    if (lights.empty()) {
+        std::fill(grid.begin(), grid.end(), 0);
+        assignments = 0;
+        return; }
+
+    workers.Run(CLUSTER_Z, AssignJob, this);
+
+    // Join the slices' lists into one.
+    for (int k=0;  k<CLUSTER_Z;  k++) {
+        const Slice& s = slices[k];
+        unsigned int base = indices.size();
+        for (int t=0;  t<CLUSTER_TILES;  t++) {
+            grid[2*(k*CLUSTER_TILES+t)] = base + s.first[t];
+            grid[2*(k*CLUSTER_TILES+t)+1] = s.count[t]; }
+        indices.insert(indices.end(), s.indices.begin(), s.indices.end()); }
+    assignments = indices.size();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Send the lights and the cluster lists to their buffer textures, and
+// bind those to their units.
+void LightClusters::Upload()
+{
+    if (!buffers[0]) {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures); }
+
+    // Never empty, so the buffer textures always have storage
+    static const PointLight none = { vec3(0.0f), 0.0f, vec3(0.0f), 0.0f };
+    if (indices.empty()) indices.push_back(0);
+
+    const void* data[3] = { lights.empty() ? &none : &lights[0], &grid[0], &indices[0] };
+    size_t bytes[3] = { sizeof(PointLight)*std::max((size_t)1, lights.size()),
+                        sizeof(unsigned int)*grid.size(),
+                        sizeof(unsigned short)*indices.size() };
+    GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+    int units[3] = { LIGHT_DATA_UNIT, CLUSTER_GRID_UNIT, LIGHT_INDEX_UNIT };
+
+    for (int i=0;  i<3;  i++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, bytes[i], data[i], GL_STREAM_DRAW);
+        glActiveTexture(GL_TEXTURE0+units[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]); }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Point the cluster samplers of a program (and of its variants) at
+// their units.
+void LightClusters::SetSamplers(ShaderProgram& shader)
+{
+    shader.SetSamplerUnit(uLightData, LIGHT_DATA_UNIT);
+    shader.SetSamplerUnit(uClusterGrid, CLUSTER_GRID_UNIT);
+    shader.SetSamplerUnit(uLightIndex, LIGHT_INDEX_UNIT);
+}
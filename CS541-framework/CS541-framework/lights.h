@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////
+// Clustered light culling for many point lights.  The view frustum is
+// divided into a grid of CLUSTER_X by CLUSTER_Y screen tiles and
+// CLUSTER_Z depth slices (spaced exponentially from CLUSTER_NEAR to
+// CLUSTER_FAR, the first and last extending to the near and far
+// planes).  Each frame, "Build" tests every light's bounding sphere
+// against the view space boxes of the clusters it might touch, on the
+// worker pool (one job per depth slice, four clusters at a time with
+// SSE), and collects a list of light indices per cluster.  "Upload"
+// sends the lights, the per-cluster (first, count) ranges and the
+// index lists to three buffer textures, which clusters.glsl walks so
+// that each pixel pays only for the lights reaching its cluster.
+//
+// Usage:
+//    clusters.lights = ...;              // World space lights
+//    clusters.Build(view, projection, front);
+//    clusters.Upload();                  // OpenGL thread
+//    ... FrameData's clusterCount and clusterDepth from
+//        Counts() and DepthParams(), and once per program:
+//    clusters.SetSamplers(shader);
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _LIGHTS
+#define _LIGHTS
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+class ShaderProgram;
+
+const int CLUSTER_X = 16;       // Multiple of 4, for SSE
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_TILES = CLUSTER_X*CLUSTER_Y;
+const int CLUSTER_COUNT = CLUSTER_TILES*CLUSTER_Z;
+const float CLUSTER_NEAR = 1.0f;
+const float CLUSTER_FAR = 300.0f;
+
+const int MAX_POINT_LIGHTS = 1024;
+
+// Texture units of the buffer textures, clear of the render queue's
+const int LIGHT_DATA_UNIT = 9;
+const int CLUSTER_GRID_UNIT = 10;
+const int LIGHT_INDEX_UNIT = 11;
+
+// Two RGBA32F texels of the light buffer texture
+struct PointLight
+{
+    vec3 position;  float radius;   // World space;  No light beyond radius
+    vec3 color;     float pad;
+};
+
+class LightClusters
+{
+public:
+    LightClusters();
+
+    std::vector<PointLight> lights;
+    int assignments;            // Light indices over all clusters
+
+    void Build(const mat4& view, const mat4& projection, const float front);
+    void Upload();
+    void SetSamplers(ShaderProgram& shader);
+
+    ivec4 Counts() const;       // Grid size, and number of lights
+    vec4 DepthParams() const;   // Slice = log(depth)*x + y
+
+    // The cluster boxes of one depth slice (view space, with depths as
+    // positive distances), and its part of the light lists.
+    struct Slice
+    {
+        float zmin, zmax;
+        float xmin[CLUSTER_X], xmax[CLUSTER_X];
+        float ymin[CLUSTER_Y], ymax[CLUSTER_Y];
+        std::vector< ::uint64_t> bits;         // Light bit masks per tile
+        std::vector<unsigned short> indices;
+        unsigned int first[CLUSTER_TILES], count[CLUSTER_TILES];
+    };
+
+private:
+    Slice slices[CLUSTER_Z];
+    mat4 boxProjection;         // Projection the boxes were built for
+    float boxFront;
+    mat4 projection;
+    std::vector<vec4> viewLights; // Center in view space, and radius
+
+    std::vector<unsigned int> grid;     // (first, count) per cluster
+    std::vector<unsigned short> indices;
+    unsigned int buffers[3], textures[3];
+
+    void BuildBoxes(const mat4& projection, const float front);
+    void AssignSlice(const int k);
+    static void AssignJob(int index, int thread, void* data);
+};
+
+#endif
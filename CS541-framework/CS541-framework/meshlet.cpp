@@ -0,0 +1,239 @@
+///////////////////////////////////////////////////////////////////////
+// Meshlets:  Clustering, bounds, and per-frame culling;  See meshlet.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define MESHLET_SSE
+#endif
+
+#include <algorithm>
+#include <math.h>
+
+#include "meshlet.h"
+#include "meshopt.h"
+#include "cputrace.h"
+
+////////////////////////////////////////////////////////////////////////
+// Grow the clusters greedily, one at a time, from a triangle next to
+// the last cluster (or the first one left):  Each step adds, of the
+// triangles touching the cluster's vertices, the one with the fewest
+// new vertices plus MESHLET_CONE_WEIGHT times its normal's deviation
+// from the cluster's average, until nothing more fits.  The model's
+// triangles are then rearranged cluster by cluster, so that each is a
+// range of the index buffer, and its vertices renumbered to match.
+// The normals are the triangles', turned to agree with the vertex
+// normals (if any).
+Meshlets::Meshlets(Model& m)
+{
+    CPU_SCOPE("Meshlets");
+    const int T = m.Tri.size();
+    const int V = m.Pnt.size();
+    const bool oriented = m.Nrm.size() == m.Pnt.size();
+
+    std::vector<vec3> normal(T, vec3(0.0f));
+    for (int t=0;  t<T;  t++) {
+        const ivec3& tri = m.Tri[t];
+        vec3 n = cross(vec3(m.Pnt[tri[1]]-m.Pnt[tri[0]]), vec3(m.Pnt[tri[2]]-m.Pnt[tri[0]]));
+        if (length(n) == 0.0f) continue;
+        n = normalize(n);
+        if (oriented && dot(n, m.Nrm[tri[0]]+m.Nrm[tri[1]]+m.Nrm[tri[2]]) < 0.0f)
+            n = -n;
+        normal[t] = n; }
+
+    // Each vertex's triangles:  adjacent[first[v]] to adjacent[first[v+1]]
+    std::vector<int> first(V+1, 0), adjacent(3*T);
+    for (int t=0;  t<T;  t++)
+        for (int c=0;  c<3;  c++)
+            first[m.Tri[t][c]+1]++;
+    for (int v=0;  v<V;  v++)
+        first[v+1] += first[v];
+    std::vector<int> fill(first.begin(), first.end()-1);
+    for (int t=0;  t<T;  t++)
+        for (int c=0;  c<3;  c++)
+            adjacent[fill[m.Tri[t][c]]++] = t;
+
+    std::vector<unsigned char> emitted(T, 0);
+    std::vector<int> cluster(V, -1);    // Cluster each vertex was last counted in
+    std::vector<int> candidates;
+    std::vector<ivec3> order;
+    std::vector<vec3> orderNormal;
+    std::vector<unsigned int> firstTri;
+    order.reserve(T);
+    int cursor = 0;
+
+    for (int k=0;  (int)order.size() < T;  k++) {
+        int t = -1;
+        for (unsigned int i=0;  i<candidates.size() && t < 0;  i++)
+            if (!emitted[candidates[i]]) t = candidates[i];
+        if (t < 0) {
+            while (emitted[cursor]) cursor++;
+            t = cursor; }
+        candidates.clear();
+        firstTri.push_back(order.size());
+        int vertices = 0, triangles = 0;
+        vec3 sum(0.0f);
+
+        while (t >= 0) {
+            emitted[t] = 1;
+            order.push_back(m.Tri[t]);
+            orderNormal.push_back(normal[t]);
+            sum += normal[t];
+            triangles++;
+            for (int c=0;  c<3;  c++) {
+                int v = m.Tri[t][c];
+                if (cluster[v] == k) continue;
+                cluster[v] = k;
+                vertices++;
+                for (int j=first[v];  j<first[v+1];  j++)
+                    if (!emitted[adjacent[j]])
+                        candidates.push_back(adjacent[j]); }
+            if (triangles == MESHLET_MAX_TRIANGLES) break;
+
+            // The best candidate that fits, dropping those taken
+            vec3 axis = length(sum) > 0.0f ? normalize(sum) : sum;
+            float bestScore = 0.0f;
+            t = -1;
+            for (unsigned int i=0;  i<candidates.size();  ) {
+                int c = candidates[i];
+                if (emitted[c]) {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue; }
+                i++;
+                int added = (cluster[m.Tri[c][0]] != k) + (cluster[m.Tri[c][1]] != k)
+                            + (cluster[m.Tri[c][2]] != k);
+                if (vertices + added > MESHLET_MAX_VERTICES) continue;
+                float score = added + MESHLET_CONE_WEIGHT*(1.0f - dot(normal[c], axis));
+                if (t < 0 || score < bestScore) {
+                    t = c;
+                    bestScore = score; } } } }
+    firstTri.push_back(order.size());
+
+    // Restore the vertex cache order within each cluster, on its own
+    // vertices numbered from 0.  (The normals keep their triangles'
+    // places, since only the bounds need them from here on.)
+    std::vector<int> global;
+    std::vector<ivec3> local;
+    std::fill(cluster.begin(), cluster.end(), -1);
+    for (unsigned int k=0;  k+1<firstTri.size();  k++) {
+        global.clear();
+        local.clear();
+        for (unsigned int t=firstTri[k];  t<firstTri[k+1];  t++) {
+            ivec3 tri;
+            for (int c=0;  c<3;  c++) {
+                int v = order[t][c];
+                if (cluster[v] < 0) {
+                    cluster[v] = global.size();
+                    global.push_back(v); }
+                tri[c] = cluster[v]; }
+            local.push_back(tri); }
+        OptimizeVertexCache(local, global.size());
+        for (unsigned int i=0;  i<local.size();  i++)
+            order[firstTri[k]+i] = ivec3(global[local[i][0]], global[local[i][1]],
+                                         global[local[i][2]]);
+        for (unsigned int i=0;  i<global.size();  i++)
+            cluster[global[i]] = -1; }
+
+    m.Tri.swap(order);
+    OptimizeVertexFetch(m);
+
+    for (unsigned int k=0;  k+1<firstTri.size();  k++) {
+        unsigned int first = firstTri[k], last = firstTri[k+1];
+        firstIndex.push_back(3*first);
+        indexCount.push_back(3*(last-first));
+
+        vec3 lo = vec3(m.Pnt[m.Tri[first][0]]), hi = lo;
+        for (unsigned int t=first;  t<last;  t++)
+            for (int c=0;  c<3;  c++) {
+                lo = min(lo, vec3(m.Pnt[m.Tri[t][c]]));
+                hi = max(hi, vec3(m.Pnt[m.Tri[t][c]])); }
+        vec3 center = (lo+hi)/2.0f;
+        float radius = 0.0f;
+        for (unsigned int t=first;  t<last;  t++)
+            for (int c=0;  c<3;  c++)
+                radius = max(radius, length(vec3(m.Pnt[m.Tri[t][c]]) - center));
+        bounds.Add(center, radius);
+
+        vec3 sum(0.0f);
+        for (unsigned int t=first;  t<last;  t++)
+            sum += orderNormal[t];
+
+        vec3 axis(0.0f, 0.0f, 1.0f);
+        float cut = 2.0f;       // Never culled
+        if (length(sum) > 0.0f) {
+            axis = normalize(sum);
+            float mindp = 1.0f;
+            for (unsigned int t=first;  t<last;  t++)
+                if (orderNormal[t] != vec3(0.0f))
+                    mindp = min(mindp, dot(orderNormal[t], axis));
+            if (mindp > 0.0f)
+                cut = sqrtf(1.0f - mindp*mindp); }
+        axisX.push_back(axis.x);
+        axisY.push_back(axis.y);
+        axisZ.push_back(axis.z);
+        cutoff.push_back(cut); }
+}
+
+int Meshlets::Cull(const Frustum& frustum, const vec3& eye,
+                   std::vector<IndirectCommand>& ranges,
+                   std::vector<unsigned char>& scratch) const
+{
+    const int n = Size();
+    if (n == 0) return 0;
+    scratch.resize(n);
+    unsigned char* visible = &scratch[0];
+    frustum.CullSpheres(bounds, visible);
+
+    // Cone test;  A cluster stays visible unless it faces away.
+    const float *x = &bounds.x[0], *y = &bounds.y[0], *z = &bounds.z[0], *r = &bounds.r[0];
+    int i = 0;
+#ifdef MESHLET_SSE
+    {
+        const __m128 ex = _mm_set1_ps(eye.x), ey = _mm_set1_ps(eye.y), ez = _mm_set1_ps(eye.z);
+        for ( ;  i+4<=n;  i+=4) {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(&x[i]), ex);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(&y[i]), ey);
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(&z[i]), ez);
+            __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                                 _mm_mul_ps(dz, dz)));
+            __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&axisX[i])),
+                                                  _mm_mul_ps(dy, _mm_loadu_ps(&axisY[i]))),
+                                       _mm_mul_ps(dz, _mm_loadu_ps(&axisZ[i])));
+            __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cutoff[i]), dist),
+                                      _mm_loadu_ps(&r[i]));
+            int away = _mm_movemask_ps(_mm_cmpge_ps(facing, limit));
+            for (int k=0;  k<4;  k++)
+                if ((away>>k) & 1) visible[i+k] = 0; }
+    }
+#endif
+
+    // Scalar remainder (or everything, without SSE)
+    for ( ;  i<n;  i++) {
+        vec3 d = vec3(x[i], y[i], z[i]) - eye;
+        if (dot(d, vec3(axisX[i], axisY[i], axisZ[i])) >= cutoff[i]*length(d) + r[i])
+            visible[i] = 0; }
+
+    // Survivors, with runs of neighbors merged into single ranges
+    int count = 0;
+    bool extend = false;
+    for (i=0;  i<n;  i++) {
+        if (!visible[i]) {
+            extend = false;
+            continue; }
+        count++;
+        if (extend) {
+            ranges.back().count += indexCount[i];
+            continue; }
+        IndirectCommand c;
+        c.count = indexCount[i];
+        c.instanceCount = 1;
+        c.firstIndex = firstIndex[i];
+        c.baseVertex = 0;
+        c.baseInstance = 0;
+        ranges.push_back(c);
+        extend = true; }
+    return count;
+}
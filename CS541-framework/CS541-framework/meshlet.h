@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////
+// Meshlets:  A large model's triangles cut into small clusters (of at
+// most MESHLET_MAX_VERTICES distinct vertices and
+// MESHLET_MAX_TRIANGLES triangles), each culled on its own every
+// frame, so that the parts of a model that are off screen or facing
+// away are never submitted.
+//
+// The clusters grow greedily over neighboring triangles, favoring
+// those that add the fewest vertices and whose normals stay closest to
+// the cluster's (by MESHLET_CONE_WEIGHT), and the model's triangles
+// are then rearranged cluster by cluster, so that each is a range of
+// its index buffer and runs of surviving neighbors merge into single
+// ranges.  That keeps the cache order only within each cluster (and
+// the overdraw order not at all), so it comes after OptimizeMesh and
+// before MakeVAO.
+//
+// Each cluster carries a bounding sphere, tested against the frustum,
+// and a cone bounding its triangles' normals:  It faces entirely away
+// from an eye at e when
+//    dot(center - e, axis) >= cutoff*length(center - e) + radius
+// (as in meshoptimizer), cutoff being the sine of the cone's
+// half angle, and more than 1 for cones too wide to ever cull.
+// Facing away only means hidden on closed surfaces, as with
+// glCullFace;  Through a hole in an open scan the inside goes missing.
+//
+// Both tests run on the bounds in structure-of-arrays form, four
+// clusters at a time with SSE (the frustum's through
+// Frustum::CullSpheres), in the model's own coordinates.
+//
+// Usage:
+//    model->meshlets = new Meshlets(*model);       // Before MakeVAO
+//    int n = model->meshlets->Cull(frustum, eye, ranges, scratch);
+// appends the index ranges to draw to ranges, as indirect draw
+// commands (see RenderQueue's RenderItem::firstRange).
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MESHLET
+#define _MESHLET
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+#include "frustum.h"
+#include "meshpool.h"
+
+using namespace glm;
+
+const int MESHLET_MAX_VERTICES = 64;
+const int MESHLET_MAX_TRIANGLES = 124;
+const unsigned int MESHLET_MIN_TRIANGLES = 8192; // Smaller models are drawn whole
+const float MESHLET_CONE_WEIGHT = 1.0f;   // Of normal deviation against new vertices
+
+class Meshlets
+{
+public:
+    Meshlets(Model& m);
+
+    int Size() const { return (int)firstIndex.size(); }
+
+    // Append the index ranges of the clusters inside frustum and not
+    // facing away from eye (both in model coordinates) to ranges;
+    // Returns the number of clusters kept.  Scratch is the caller's,
+    // so that several threads may cull one model.
+    int Cull(const Frustum& frustum, const vec3& eye,
+             std::vector<IndirectCommand>& ranges,
+             std::vector<unsigned char>& scratch) const;
+
+    // Per cluster:  Its range of the index buffer, bounding sphere and
+    // normal cone
+    std::vector<unsigned int> firstIndex, indexCount;
+    SphereBatch bounds;
+    std::vector<float> axisX, axisY, axisZ, cutoff;
+};
+
+#endif
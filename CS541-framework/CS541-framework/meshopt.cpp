@@ -0,0 +1,329 @@
+///////////////////////////////////////////////////////////////////////
+// Mesh optimization:  Triangulation, vertex cache, overdraw and vertex
+// fetch ordering.  See meshopt.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+#include "meshopt.h"
+#include "cputrace.h"
+
+void OptimizeMesh(Model& m, const char* name)
+{
+    CPU_SCOPE("OptimizeMesh");
+    Triangulate(m);
+    if (m.Tri.empty()) return;
+
+    // Small, regular meshes (such as the teapot's coarse patches) may
+    // already be in a better order for the FIFO cache than either
+    // reordering finds;  Each step is kept only if it does no harm
+    // (beyond the overdraw order's allowance).
+    MeshStats before = AnalyzeVertexCache(m.Tri, m.Pnt.size());
+    std::vector<ivec3> previous = m.Tri;
+    OptimizeVertexCache(m.Tri, m.Pnt.size());
+    float acmr = AnalyzeVertexCache(m.Tri, m.Pnt.size()).acmr;
+    if (acmr > before.acmr) {
+        m.Tri.swap(previous);
+        acmr = before.acmr; }
+
+    previous = m.Tri;
+    OptimizeOverdraw(m.Tri, m.Pnt, OVERDRAW_THRESHOLD);
+    if (AnalyzeVertexCache(m.Tri, m.Pnt.size()).acmr > OVERDRAW_THRESHOLD*acmr)
+        m.Tri.swap(previous);
+
+    OptimizeVertexFetch(m);
+    MeshStats after = AnalyzeVertexCache(m.Tri, m.Pnt.size());
+
+    printf("%s (%d triangles):  ACMR %.3f -> %.3f,  ATVR %.3f -> %.3f\n",
+           name, (int)m.Tri.size(), before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+// Split each quad (a, b, c, d) into (a, b, c) and (a, c, d), as the
+// driver would have.
+void Triangulate(Model& m)
+{
+    m.Tri.reserve(m.Tri.size() + 2*m.Quad.size());
+    for (unsigned int i=0;  i<m.Quad.size();  i++) {
+        const ivec4& q = m.Quad[i];
+        m.Tri.push_back(ivec3(q[0], q[1], q[2]));
+        m.Tri.push_back(ivec3(q[0], q[2], q[3])); }
+    std::vector<ivec4>().swap(m.Quad);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Cache statistics.  A FIFO cache is simulated with a time stamp per
+// vertex, the time counting misses:  A vertex is in the cache if it
+// was last loaded fewer than VERTEX_CACHE_SIZE misses ago.  Starting
+// time past every stamp plus the cache size empties the cache.
+class FifoCache
+{
+public:
+    FifoCache(const int vertexCount) :stamps(vertexCount, 0), time(VERTEX_CACHE_SIZE+1) {}
+    void Clear() { time += VERTEX_CACHE_SIZE+1; }
+
+    // Misses of triangle t:  0 to 3
+    int Misses(const ivec3& t)
+    {
+        int misses = 0;
+        for (int c=0;  c<3;  c++)
+            if (time - stamps[t[c]] > (unsigned int)VERTEX_CACHE_SIZE) {
+                stamps[t[c]] = time++;
+                misses++; }
+        return misses;
+    }
+
+private:
+    std::vector<unsigned int> stamps;
+    unsigned int time;
+};
+
+MeshStats AnalyzeVertexCache(const std::vector<ivec3>& tris, const int vertexCount)
+{
+    FifoCache cache(vertexCount);
+    std::vector<bool> used(vertexCount, false);
+    int misses = 0, usedCount = 0;
+    for (unsigned int t=0;  t<tris.size();  t++) {
+        misses += cache.Misses(tris[t]);
+        for (int c=0;  c<3;  c++)
+            if (!used[tris[t][c]]) {
+                used[tris[t][c]] = true;
+                usedCount++; } }
+
+    MeshStats s;
+    s.acmr = tris.empty() ? 0.0f : float(misses)/tris.size();
+    s.atvr = usedCount ? float(misses)/usedCount : 0.0f;
+    return s;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Forsyth's vertex scores:  High for vertices near the front of the
+// cache (but a little lower for the three just used, to discourage
+// long strips), plus a boost for vertices with few triangles left so
+// that lone triangles are not left stranded.
+static float VertexScore(const int cachePos, const int remaining)
+{
+    if (remaining == 0)
+        return -1.0f;           // No triangles left to draw
+
+    float score = 0.0f;
+    if (cachePos >= 0) {
+        if (cachePos < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - float(cachePos-3)/(FORSYTH_CACHE_SIZE-3), 1.5f); }
+    return score + 2.0f/sqrtf((float)remaining);
+}
+
+void OptimizeVertexCache(std::vector<ivec3>& tris, const int vertexCount)
+{
+    CPU_SCOPE("OptimizeVertexCache");
+    const int T = tris.size();
+
+    // Each vertex's triangles, all in one array:  adjacent[first[v]]
+    // on, the first remaining[v] of them not yet emitted.
+    std::vector<int> remaining(vertexCount, 0), first(vertexCount+1, 0);
+    for (int t=0;  t<T;  t++)
+        for (int c=0;  c<3;  c++)
+            remaining[tris[t][c]]++;
+    for (int v=0;  v<vertexCount;  v++)
+        first[v+1] = first[v] + remaining[v];
+    std::vector<int> adjacent(3*T), fill(first.begin(), first.end()-1);
+    for (int t=0;  t<T;  t++)
+        for (int c=0;  c<3;  c++)
+            adjacent[fill[tris[t][c]]++] = t;
+
+    std::vector<int> cachePos(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (int v=0;  v<vertexCount;  v++)
+        score[v] = VertexScore(-1, remaining[v]);
+    std::vector<float> triScore(T);
+    int best = 0;
+    for (int t=0;  t<T;  t++) {
+        triScore[t] = score[tris[t][0]] + score[tris[t][1]] + score[tris[t][2]];
+        if (triScore[t] > triScore[best]) best = t; }
+
+    std::vector<bool> emitted(T, false);
+    std::vector<ivec3> order;
+    order.reserve(T);
+    int cache[FORSYTH_CACHE_SIZE+3], cacheSize = 0;
+    int cursor = 0;
+
+    while ((int)order.size() < T) {
+        // With no candidate in the cache, take the next triangle left.
+        if (best < 0) {
+            while (emitted[cursor]) cursor++;
+            best = cursor; }
+
+        const ivec3 tri = tris[best];
+        emitted[best] = true;
+        order.push_back(tri);
+
+        // Take it off its vertices' lists.
+        for (int c=0;  c<3;  c++) {
+            int v = tri[c];
+            int* list = &adjacent[first[v]];
+            int n = remaining[v]--;
+            for (int i=0;  i<n;  i++)
+                if (list[i] == best) {
+                    std::swap(list[i], list[n-1]);
+                    break; } }
+
+        // Its vertices move to the front of the cache, pushing the
+        // rest back (and the last few out).
+        int next[FORSYTH_CACHE_SIZE+3];
+        int nextSize = 0;
+        for (int c=0;  c<3;  c++)
+            next[nextSize++] = tri[c];
+        for (int i=0;  i<cacheSize;  i++)
+            if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                next[nextSize++] = cache[i];
+
+        // Rescore those vertices, and with them their triangles.
+        for (int i=0;  i<nextSize;  i++) {
+            int v = next[i];
+            cachePos[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+            float s = VertexScore(cachePos[v], remaining[v]);
+            float delta = s - score[v];
+            score[v] = s;
+            for (int j=0;  j<remaining[v];  j++)
+                triScore[adjacent[first[v]+j]] += delta; }
+        cacheSize = std::min(nextSize, FORSYTH_CACHE_SIZE);
+        std::copy(next, next+cacheSize, cache);
+
+        // The best triangle left that uses a cached vertex
+        best = -1;
+        float bestScore = -1.0f;
+        for (int i=0;  i<cacheSize;  i++) {
+            int v = cache[i];
+            for (int j=0;  j<remaining[v];  j++) {
+                int t = adjacent[first[v]+j];
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = t; } } } }
+
+    tris.swap(order);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Overdraw ordering, of the cache-ordered triangles
+struct Cluster
+{
+    int start, end;             // Range of triangles
+    float sortKey;              // Most outward-facing is largest
+};
+
+static bool MoreOutward(const Cluster& a, const Cluster& b)
+{
+    return a.sortKey > b.sortKey;
+}
+
+void OptimizeOverdraw(std::vector<ivec3>& tris, const std::vector<vec4>& Pnt,
+                      const float threshold)
+{
+    CPU_SCOPE("OptimizeOverdraw");
+    const int T = tris.size();
+    FifoCache cache(Pnt.size());
+
+    // Hard boundaries:  Where a triangle misses on all three vertices,
+    // the ordering has jumped elsewhere and the cache starts over.
+    std::vector<int> hard;
+    for (int t=0;  t<T;  t++)
+        if (cache.Misses(tris[t]) == 3)
+            hard.push_back(t);
+    hard.push_back(T);
+
+    // Soft boundaries:  Within each of those clusters, cut wherever
+    // the part since the last cut (cached from scratch) does no worse
+    // than threshold times the whole cluster's ACMR.
+    std::vector<Cluster> clusters;
+    for (unsigned int h=0;  h+1<hard.size();  h++) {
+        int start = hard[h], end = hard[h+1];
+        cache.Clear();
+        int misses = 0;
+        for (int t=start;  t<end;  t++)
+            misses += cache.Misses(tris[t]);
+        float limit = threshold*misses/(end-start);
+
+        cache.Clear();
+        misses = 0;
+        for (int t=start;  t<end;  t++) {
+            misses += cache.Misses(tris[t]);
+            if (t+1 == end || float(misses)/(t+1-start) <= limit) {
+                Cluster c = { start, t+1, 0.0f };
+                clusters.push_back(c);
+                start = t+1;
+                cache.Clear();
+                misses = 0; } } }
+
+    // Each cluster's area-weighted center and normal
+    vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<vec3> centers(clusters.size()), normals(clusters.size());
+    for (unsigned int k=0;  k<clusters.size();  k++) {
+        vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (int t=clusters[k].start;  t<clusters[k].end;  t++) {
+            vec3 a(Pnt[tris[t][0]]), b(Pnt[tris[t][1]]), c(Pnt[tris[t][2]]);
+            vec3 n = cross(b-a, c-a);
+            float w = length(n);
+            center += w*(a+b+c)/3.0f;
+            normal += n;
+            area += w; }
+        centers[k] = area > 0.0f ? center/area : vec3(Pnt[tris[clusters[k].start][0]]);
+        normals[k] = length(normal) > 0.0f ? normalize(normal) : vec3(0.0f);
+        meshCenter += center;
+        meshArea += area; }
+    if (meshArea > 0.0f) meshCenter /= meshArea;
+
+    for (unsigned int k=0;  k<clusters.size();  k++)
+        clusters[k].sortKey = dot(centers[k] - meshCenter, normals[k]);
+    std::stable_sort(clusters.begin(), clusters.end(), MoreOutward);
+
+    std::vector<ivec3> order;
+    order.reserve(T);
+    for (unsigned int k=0;  k<clusters.size();  k++)
+        order.insert(order.end(), tris.begin()+clusters[k].start,
+                     tris.begin()+clusters[k].end);
+    tris.swap(order);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Vertex fetch ordering
+
+// Permute array a so that element i is the old a[order[i]].
+template <class T> static void Reorder(std::vector<T>& a, const std::vector<int>& order)
+{
+    if (a.empty()) return;
+    std::vector<T> r(order.size());
+    for (unsigned int i=0;  i<order.size();  i++)
+        r[i] = a[order[i]];
+    a.swap(r);
+}
+
+// Number vertices in order of first use;  Any unused ones go last.
+void OptimizeVertexFetch(Model& m)
+{
+    const int n = m.Pnt.size();
+    std::vector<int> remap(n, -1), order;
+    order.reserve(n);
+    for (unsigned int t=0;  t<m.Tri.size();  t++)
+        for (int c=0;  c<3;  c++) {
+            int& v = m.Tri[t][c];
+            if (remap[v] < 0) {
+                remap[v] = order.size();
+                order.push_back(v); }
+            v = remap[v]; }
+    for (int v=0;  v<n;  v++)
+        if (remap[v] < 0) {
+            remap[v] = order.size();
+            order.push_back(v); }
+
+    Reorder(m.Pnt, order);
+    Reorder(m.Nrm, order);
+    Reorder(m.Tex, order);
+    Reorder(m.Tan, order);
+}
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////
+// Mesh optimization, run on each model once it is built and before its
+// VAO is made.  OptimizeMesh applies, in order:
+//
+// Triangulation:  Quads become two triangles each, so that no model
+//   draws GL_QUADS (which core profiles lack, and which drivers split
+//   on the fly anyway).
+// Vertex cache order:  Triangles are reordered for the post-transform
+//   vertex cache with Forsyth's "linear speed vertex cache
+//   optimisation", which greedily emits the best-scoring triangle of
+//   the vertices in a modeled LRU cache of FORSYTH_CACHE_SIZE entries.
+// Overdraw order:  The cache-ordered list is cut into clusters
+//   wherever the cache starts over anyway (and, while the cost stays
+//   within OVERDRAW_THRESHOLD of the cluster's own, in between), and
+//   the clusters are sorted most outward-facing first (by their
+//   area-weighted normal against their center's offset from the
+//   mesh's), so that surfaces likely in front are drawn first.  See
+//   Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+//   Locality and Reduced Overdraw".
+// Vertex fetch order:  Vertices are renumbered in the order the
+//   triangles first use them, so vertex fetches walk memory forward.
+//
+// The average cache miss ratio (ACMR:  Transformed vertices per
+// triangle) and average transform to vertex ratio (ATVR:  Transformed
+// vertices per vertex, 1 being ideal) of a FIFO cache of
+// VERTEX_CACHE_SIZE entries are printed before and after.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MESHOPT
+#define _MESHOPT
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+using namespace glm;
+
+const int VERTEX_CACHE_SIZE = 16;      // FIFO cache the statistics model
+const int FORSYTH_CACHE_SIZE = 32;     // LRU cache the ordering models
+const float OVERDRAW_THRESHOLD = 1.05f; // Allowed growth of a cluster's ACMR
+
+struct MeshStats
+{
+    float acmr, atvr;
+};
+
+void OptimizeMesh(Model& m, const char* name);
+
+// The steps of OptimizeMesh
+void Triangulate(Model& m);
+void OptimizeVertexCache(std::vector<ivec3>& tris, const int vertexCount);
+void OptimizeOverdraw(std::vector<ivec3>& tris, const std::vector<vec4>& Pnt,
+                      const float threshold);
+void OptimizeVertexFetch(Model& m);
+MeshStats AnalyzeVertexCache(const std::vector<ivec3>& tris, const int vertexCount);
+
+#endif
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////
+// A shared pool of geometry for multi-draw submission;  See
+// meshpool.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "meshpool.h"
+#include "vertexbuffer.h"
+
+// Reserve a model's vertices and triangles in the pool, and record
+// its range in the model.  Returns false (and adds nothing) if the
+// model's vertex layout (or packing) differs from that of the models
+// already in the pool.  All models must be added before Upload, and must keep
+// their arrays until then.
+bool MeshPool::Add(Model* m)
+{
+    int l = PresentAttributes(VertexSources(*m));
+    if (layout >= 0 && (l != layout || m->packing != packing))
+        return false;
+    layout = l;
+    packing = m->packing;
+    shortIndices = shortIndices && m->Pnt.size() <= MAX_SHORT_INDEX_VERTICES;
+
+    m->pool = this;
+    m->poolBaseVertex = vertexCount;
+    m->poolFirstIndex = indexCount;
+    m->poolIndexCount = 3*m->Tri.size();
+    vertexCount += m->Pnt.size();
+    indexCount += m->poolIndexCount;
+    models.push_back(m);
+    return true;
+}
+
+// Write every model into the buffers of a VertexBuilder of layout L,
+// each model's indices relative to its own first vertex.
+template <class L> void MeshPool::Build()
+{
+    VertexBuilder<L> builder(vertexCount, indexCount, shortIndices);
+    for (unsigned int i=0;  i<models.size();  i++) {
+        const Model* m = models[i];
+        builder.AddVertices(VertexSources(*m));
+        if (m->Tri.size())
+            builder.AddIndices(&m->Tri[0][0], 3*m->Tri.size()); }
+    vao = builder.Finish();
+    indexType = builder.indexType;
+}
+
+// Create the pool's VAO and buffers from everything added.
+void MeshPool::Upload()
+{
+    if (!vertexCount) return;
+
+    WithLayout(layout, packing, *this);
+    std::vector<Model*>().swap(models);
+
+    glBindVertexArray(vao);
+    glGenBuffers(1, &instanceBuffer);
+    BindInstanceAttributes(instanceBuffer);
+    glBindVertexArray(0);
+    ReserveInstances(64);
+}
+
+// Make room for n instance records.  Growing the buffer discards its
+// contents, so call this before filling it for the frame.
+void MeshPool::ReserveInstances(const int n)
+{
+    if (n <= instanceCapacity) return;
+    instanceCapacity = n > 2*instanceCapacity ? n : 2*instanceCapacity;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData)*instanceCapacity, NULL,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////
+// A shared pool of geometry for multi-draw submission.  The vertices
+// of all Models added to a pool live in one interleaved vertex buffer
+// (attributes in the slots listed in models.h) and their triangles in
+// one index buffer, with each model's indices relative
+// to its own first vertex (the "base vertex").  A single VAO covers
+// them all, so any number of pooled models can be drawn by one
+// glMultiDrawElementsIndirect call with no VAO changes in between.
+//
+// Only models with the same vertex layout (the same set of attributes
+// present, and all packed or all not) can share a pool;  Add refuses
+// the others, which are then drawn from their own VAOs as before.  Add
+// only reserves the model's ranges;  Upload writes every model's
+// vertices and indices straight into the mapped buffers (see
+// vertexbuffer.h), so the pool never holds a copy of the geometry.
+// Models arrive already triangulated (by MakeVAO), and indices are 16
+// bits if every model's vertex count allows.  Each model keeps its own
+// positionDecode.  The pool's VAO also carries the instance attributes
+// (slots #4-#11), read from the pool's own instance buffer.
+//
+// Usage:
+//    pool.Add(model1);  pool.Add(model2); ...
+//    pool.Upload();
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MESHPOOL
+#define _MESHPOOL
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+using namespace glm;
+
+// The command record read by glMultiDrawElementsIndirect.
+struct IndirectCommand
+{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+class MeshPool
+{
+public:
+    MeshPool() :vao(0), indexType(0), instanceBuffer(0), instanceCapacity(0),
+                layout(-1), packing(PACK_NONE), shortIndices(true),
+                vertexCount(0), indexCount(0) {}
+
+    // Defined by Upload
+    unsigned int vao;
+    unsigned int indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    unsigned int instanceBuffer;
+    int instanceCapacity;       // InstanceData records in instanceBuffer
+
+    bool Add(Model* m);
+    void Upload();
+    void ReserveInstances(const int n);
+
+private:
+    int layout;                 // Attributes present (PresentAttributes)
+    VertexPacking packing;      // How the vertices are packed
+    bool shortIndices;          // Every model has few enough vertices
+    std::vector<Model*> models;
+    unsigned int vertexCount, indexCount;
+
+public:
+    template <class L> void Build();  // For WithLayout
+};
+
+#endif
@@ -1,9 +1,9 @@
 ////////////////////////////////////////////////////////////////////////
 // A small library of object shapes (ground plane, sphere, and the
-// famous Utah teapot), each created as a batch of Vertex Buffer
-// Objects collected under a Vertex Array Object umbrella.  This is
-// the latest and most efficient way to get geometry into the OpenGL
-// graphics pipeline.
+// famous Utah teapot), each created as one interleaved Vertex Buffer
+// Object (and an index buffer) under a Vertex Array Object umbrella.
+// This is the latest and most efficient way to get geometry into the
+// OpenGL graphics pipeline.
 //
 // Each vertex is specified as four attributes which are made
 // available in a vertes shader in the following attribute slots.
@@ -13,12 +13,14 @@
 // texture coord,   vec3,   attribute #2
 // tangent,         vec3,   attribute #3
 //
-// An instance of any of these shapes is create with a single call:
-//    unsigned int obj = CreateSphere(divisions, &quadCount);
+// An instance of any of these shapes is created with a single call:
+//    Model* sphere = new Sphere(divisions);
 // and drawn by:
-//    glBindVertexArray(obj);
-//    glDrawElements(GL_QUADS, quadCount, GL_UNSIGNED_INT, 0);
+//    glBindVertexArray(sphere->vao);
+//    glDrawElements(GL_TRIANGLES, 3*sphere->count, sphere->indexType, 0);
 //    glBindVertexArray(0);
+// (the index type being GL_UNSIGNED_SHORT for small packed models), or
+// simply by sphere->DrawVAO().
 //
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
@@ -26,6 +28,7 @@
 #include <vector>
 #include <fstream>
 #include <stdlib.h>
+#include <stddef.h>
 #include <glload/gl_3_3.h>
 #include <glload/gl_load.hpp>
 #include <glm/glm.hpp>
@@ -33,141 +36,70 @@
 
 #include "math.h"
 #include "models.h"
+#include "vertexbuffer.h"
+#include "meshopt.h"
+#include "simplify.h"
+#include "meshlet.h"
 #include "rply.h"
+#include "cputrace.h"
 
 const float PI = 3.14159f;
 const float rad = PI/180.0f;
 mat4 Identity(1.0);
 
 ////////////////////////////////////////////////////////////////////////////////
-// Create a Vertex Array Object from (1) a collection of arrays
-// containing vertex data and (2) a set of indices inticating quads.
-// The arrays must all be the same length and contain respectively,
-// the vertex position, normal, texture coordinate, and tangent
-// vector.  This is the latest and most efficient way to get geometry
-// into the OpenGL graphics pipeline.
-unsigned int VaoFromQuads(std::vector<vec4> Pnt,
-                          std::vector<vec3> Nrm,
-                          std::vector<vec2> Tex,
-                          std::vector<vec3> Tan,
-                          std::vector<ivec4> Quad)
+// Create a Vertex Array Object from a model's arrays of vertex data
+// (position, normal, texture coordinate and tangent, all the same
+// length) and its triangle indices, as one interleaved vertex buffer
+// of layout L.  The data goes straight from the model's arrays into
+// the mapped buffers.
+struct VaoFromModel
 {
-    unsigned int vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    GLuint Pbuff;
-    glGenBuffers(1, &Pbuff);
-    glBindBuffer(GL_ARRAY_BUFFER, Pbuff);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*Pnt.size(),
-                 &Pnt[0][0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    if (Nrm.size() > 0) {
-        GLuint Nbuff;
-        glGenBuffers(1, &Nbuff);
-        glBindBuffer(GL_ARRAY_BUFFER, Nbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Pnt.size(),
-                     &Nrm[0][0], GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0); }
-
-    if (Tex.size() > 0) {
-        GLuint Tbuff;
-        glGenBuffers(1, &Tbuff);
-        glBindBuffer(GL_ARRAY_BUFFER, Tbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*2*Pnt.size(),
-                     &Tex[0][0], GL_STATIC_DRAW);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0); }
-
-    if (Tan.size() > 0) {
-        GLuint Dbuff;
-        glGenBuffers(1, &Dbuff);
-        glBindBuffer(GL_ARRAY_BUFFER, Dbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Pnt.size(),
-                     &Tan[0][0], GL_STATIC_DRAW);
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0); }
-
-    GLuint Ibuff;
-    glGenBuffers(1, &Ibuff);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Ibuff);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int)*4*Quad.size(),
-                 &Quad[0][0], GL_STATIC_DRAW);
-
-    glBindVertexArray(0);
-
-    return vao;
+    Model& m;
+    VaoFromModel(Model& _m) :m(_m) {}
+    template <class L> void Build()
+    {
+        VertexBuilder<L> builder(m.Pnt.size(), 3*m.Tri.size(),
+                                 m.Pnt.size() <= MAX_SHORT_INDEX_VERTICES);
+        builder.AddVertices(VertexSources(m));
+        if (m.Tri.size())
+            builder.AddIndices(&m.Tri[0][0], 3*m.Tri.size());
+        m.vao = builder.Finish();
+        m.indexType = builder.indexType;
+    }
+};
+
+bool Model::quantizeVertices = true;
+
+Model::~Model()
+{
+    for (unsigned int i=0;  i<lods.size();  i++)
+        delete lods[i];
+    delete meshlets;
 }
 
-unsigned int VaoFromTris(std::vector<vec4> Pnt,
-                         std::vector<vec3> Nrm,
-                         std::vector<vec2> Tex,
-                         std::vector<vec3> Tan,
-                         std::vector<ivec3> Tri)
+////////////////////////////////////////////////////////////////////////
+// Pick the level of detail for a model covering pixels pixels (its
+// projected diameter), given the level used last time.  A finer level
+// is taken as soon as the current one is too coarse, but a coarser
+// one only once the size is a margin below its limit, so that sizes
+// near a limit don't flip between levels from frame to frame.
+int Model::SelectLod(const float pixels, int current) const
 {
-    unsigned int vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    GLuint Pbuff;
-    glGenBuffers(1, &Pbuff);
-    glBindBuffer(GL_ARRAY_BUFFER, Pbuff);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*Pnt.size(),
-                 &Pnt[0][0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    if (Nrm.size() > 0) {
-        GLuint Nbuff;
-        glGenBuffers(1, &Nbuff);
-        glBindBuffer(GL_ARRAY_BUFFER, Nbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Pnt.size(),
-                     &Nrm[0][0], GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0); }
-
-    if (Tex.size() > 0) {
-        GLuint Tbuff;
-        glGenBuffers(1, &Tbuff);
-        glBindBuffer(GL_ARRAY_BUFFER, Tbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*2*Pnt.size(),
-                     &Tex[0][0], GL_STATIC_DRAW);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0); }
-
-    if (Tan.size() > 0) {
-        GLuint Dbuff;
-        glGenBuffers(1, &Dbuff);
-        glBindBuffer(GL_ARRAY_BUFFER, Dbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Pnt.size(),
-                     &Tan[0][0], GL_STATIC_DRAW);
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0); }
-
-    GLuint Ibuff;
-    glGenBuffers(1, &Ibuff);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Ibuff);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int)*3*Tri.size(),
-                 &Tri[0][0], GL_STATIC_DRAW);
-
-    glBindVertexArray(0);
-
-    return vao;
+    const float HYSTERESIS = 0.8f;
+    const int n = Levels();
+    if (current >= n) current = n-1;
+    if (current < 0) current = 0;
+    while (current > 0 && pixels > lods[current-1]->lodPixels)
+        current--;
+    while (current+1 < n && pixels < HYSTERESIS*lods[current]->lodPixels)
+        current++;
+    return current;
 }
 
 void Model::ComputeSize()
 {
+    CPU_SCOPE("ComputeSize");
     // Compute min/max
     minP = swizzle<X,Y,Z>(Pnt[0]);
     maxP = swizzle<X,Y,Z>(Pnt[0]);
@@ -181,32 +113,133 @@ void Model::ComputeSize()
     for (int c=0;  c<3;  c++)
         size = max(size, (maxP[c]-minP[c])/2.0f);
 
+    radius = length(maxP-minP)/2.0f;
+
     float s = 1.0/size;
     modelTr = scale(Identity, s,s,s)*translate(-center);
 }
 
+////////////////////////////////////////////////////////////////////////
+// World-space bounds of the model under transformation tr.  The box
+// is the axis aligned box around the transformed minP..maxP box (each
+// half-extent is the sum of the box's half-extents weighted by the
+// absolute values of a row of tr's upper 3x3), and the sphere is the
+// transformed bounding sphere, scaled by tr's largest axis scale.
+void Model::WorldBox(const mat4& tr, vec3& boxCenter, vec3& boxExtent) const
+{
+    vec3 e = (maxP-minP)/2.0f;
+    boxCenter = vec3(tr*vec4(center, 1.0f));
+    for (int i=0;  i<3;  i++)
+        boxExtent[i] = fabs(tr[0][i])*e[0] + fabs(tr[1][i])*e[1] + fabs(tr[2][i])*e[2];
+}
+
+void Model::WorldSphere(const mat4& tr, vec3& sphereCenter, float& sphereRadius) const
+{
+    float s = max(length(vec3(tr[0])), max(length(vec3(tr[1])), length(vec3(tr[2]))));
+    sphereCenter = vec3(tr*vec4(center, 1.0f));
+    sphereRadius = s*radius;
+}
+
 void Model::MakeVAO()
 {
-    if (Quad.size()) {
-        vao = VaoFromQuads(Pnt, Nrm, Tex, Tan, Quad);
-        count = Quad.size();
-        shape = 4; }
-    else {
-        vao = VaoFromTris(Pnt, Nrm, Tex, Tan, Tri);
-        count = Tri.size();
-        shape = 3; }
+    CPU_SCOPE("MakeVAO");
+    Triangulate(*this);         // Done already, if optimized
+
+    // The bounds from ComputeSize put every position within size of
+    // center in each coordinate.
+    packing = quantizeVertices ? Packing(VertexSources(*this)) : PACK_NONE;
+    positionDecode = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    if (packing != PACK_NONE)
+        positionDecode = vec4(center, size > 0.0f ? size : 1.0f);
+
+    VaoFromModel build(*this);
+    WithLayout(PresentAttributes(VertexSources(*this)), packing, build);
+    count = Tri.size();
+    shape = 3;
 }
 
 void Model::DrawVAO()
 {
     glBindVertexArray(vao);
-    if (shape==4)
-        glDrawElements(GL_QUADS, shape*count, GL_UNSIGNED_INT, 0);
-    else
-        glDrawElements(GL_TRIANGLES, shape*count, GL_UNSIGNED_INT, 0);
+    DrawElements();
     glBindVertexArray(0);
 }
 
+// Issue the draw call only;  The caller has bound the model's VAO.
+void Model::DrawElements()
+{
+    glDrawElements(GL_TRIANGLES, shape*count, indexType, 0);
+}
+
+void BindInstanceAttributes(const unsigned int buffer)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    const int stride = sizeof(InstanceData);
+    for (int c=0;  c<4;  c++) {
+        glEnableVertexAttribArray(4+c);
+        glVertexAttribPointer(4+c, 4, GL_FLOAT, GL_FALSE, stride,
+            (void*)(offsetof(InstanceData, modelTr) + c*sizeof(vec4)));
+        glVertexAttribDivisor(4+c, 1); }
+    for (int c=0;  c<3;  c++) {
+        glEnableVertexAttribArray(8+c);
+        glVertexAttribPointer(8+c, 3, GL_FLOAT, GL_FALSE, stride,
+            (void*)(offsetof(InstanceData, normalTr) + c*sizeof(vec3)));
+        glVertexAttribDivisor(8+c, 1); }
+    glEnableVertexAttribArray(11);
+    glVertexAttribPointer(11, 3, GL_FLOAT, GL_FALSE, stride,
+                          (void*)offsetof(InstanceData, diffuseColor));
+    glVertexAttribDivisor(11, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Upload an array of per-instance records for DrawInstanced.  The
+// instance buffer is created (and attached to the model's VAO with an
+// attribute divisor of one) on first use, and refilled on later calls.
+void Model::SetInstances(const InstanceData* data, const int n)
+{
+    if (!instanceBuffer) {
+        glGenBuffers(1, &instanceBuffer);
+        glBindVertexArray(vao);
+        BindInstanceAttributes(instanceBuffer);
+        glBindVertexArray(0); }
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData)*n, data, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    instanceCount = n;
+}
+
+// Overwrite instances [first, first+n) of those given to SetInstances.
+// Calling SetInstances(NULL, total) first, then this once per piece,
+// uploads an instance list that was built in several pieces without
+// copying it together.
+void Model::UpdateInstances(const InstanceData* data, const int first, const int n)
+{
+    if (n <= 0) return;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(InstanceData)*first,
+                    sizeof(InstanceData)*n, data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Draw all instances set by SetInstances with a single call.
+void Model::DrawInstanced()
+{
+    glBindVertexArray(vao);
+    DrawElementsInstanced();
+    glBindVertexArray(0);
+}
+
+void Model::DrawElementsInstanced()
+{
+    if (!instanceCount) return;
+    glDrawElementsInstanced(GL_TRIANGLES, shape*count, indexType, 0,
+                            instanceCount);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Data for the Utah teapot.  It consists of a list of 306 control
 // points, and 32 Bezier patches, each defined by 16 control points
@@ -362,8 +395,9 @@ vec3 TeapotPoints[] = {
 ////////////////////////////////////////////////////////////////////////////////
 // Builds a Vertex Array Object for the Utah teapot.  Each of the 32
 // patches is represented by an n by n grid of quads.
-Teapot::Teapot(const int n)
+Teapot::Teapot(const int n, const int levels)
 {
+    CPU_SCOPE("Teapot");
     diffuseColor = vec3(0.5, 0.5, 0.1);
     specularColor = vec3(1.0, 1.0, 1.0);
     shininess = 120.0;
@@ -456,14 +490,21 @@ Teapot::Teapot(const int n)
                                           p*(n+1)*(n+1) + (i-1)*(n+1) + (j),
                                           p*(n+1)*(n+1) + (i  )*(n+1) + (j),
                                           p*(n+1)*(n+1) + (i  )*(n+1) + (j-1))); } } }
+    OptimizeMesh(*this, "Teapot");
     ComputeSize();
     MakeVAO();
+
+    // About four patches, of n segments each, span the teapot.
+    lodPixels = 4.0f*n*LOD_PIXELS_PER_SEGMENT;
+    for (int k=1, m=n/2;  k<levels && k<MAX_LODS && m>=2;  k++, m/=2)
+        lods.push_back(new Teapot(m));
 }
 
 ////////////////////////////////////////////////////////////////////////
 // Generates a sphere with normals, texture coords, and tangent vectors.
-Sphere::Sphere(const int n)
+Sphere::Sphere(const int n, const int levels)
 {
+    CPU_SCOPE("Sphere");
     diffuseColor = vec3(0.5, 0.5, 1.0);
     specularColor = vec3(1.0, 1.0, 1.0);
     shininess = 120.0;
@@ -485,17 +526,23 @@ Sphere::Sphere(const int n)
                                       (i-1)*(n+1) + (j),
                                       (i  )*(n+1) + (j),
                                       (i  )*(n+1) + (j-1))); } } }
-    printf("shpere: ");
+    OptimizeMesh(*this, "Sphere");
     ComputeSize();
     MakeVAO();
+
+    // A half circle of n segments spans the diameter.
+    lodPixels = 2.0f*n*LOD_PIXELS_PER_SEGMENT/PI;
+    for (int k=1, m=n/2;  k<levels && k<MAX_LODS && m>=2;  k++, m/=2)
+        lods.push_back(new Sphere(m));
 }
 
 ////////////////////////////////////////////////////////////////////////
 // Generates a plane with normals, texture coords, and tangent vectors
 // from an n by n grid of small quads.  A single quad might have been
 // sufficient, but that works poorly with the reflection map.
-Ply::Ply(const char* name, const bool reverse)
+Ply::Ply(const char* name, const bool reverse, const int levels, const float lodRatio)
 {
+    CPU_SCOPE("Ply");
     diffuseColor = vec3(0.8, 0.8, 0.5);
     specularColor = vec3(1.0, 1.0, 1.0);
     shininess = 120.0;
@@ -514,7 +561,10 @@ Ply::Ply(const char* name, const bool reverse)
     ply_set_read_cb(ply, "face", "vertex_indices", face_cb, this, 0);
 
     // Read the PLY file filling the arrays via the callbacks.
-    if (!ply_read(ply)) {printf("Failure in ply_read\n"); exit(-1); }
+    {
+        CPU_SCOPE("ply_read");
+        if (!ply_read(ply)) {printf("Failure in ply_read\n"); exit(-1); }
+    }
 
 
     // Zero out the vertex normals
@@ -547,8 +597,13 @@ Ply::Ply(const char* name, const bool reverse)
     for (int i=0;  i<Pnt.size();  i++)
         Nrm[i] = normalize(Nrm[i]);
 
+    OptimizeMesh(*this, name);
+    if (Tri.size() >= MESHLET_MIN_TRIANGLES)
+        meshlets = new Meshlets(*this);
     ComputeSize();
     MakeVAO();
+
+    BuildLods(*this, name, levels, lodRatio);
 }
  
 
@@ -598,14 +653,9 @@ int Ply::face_cb(p_ply_argument argument) {
 // Generates a plane with normals, texture coords, and tangent vectors
 // from an n by n grid of small quads.  A single quad might have been
 // sufficient, but that works poorly with the reflection map.
-Ground::Ground(const float r, const int n)
+Ground::Ground(const float r, const int n, const int levels)
 {
-    std::vector<vec4> Pnt;
-    std::vector<vec3> Nrm;
-    std::vector<vec2> Tex;
-    std::vector<vec3> Tan;
-    std::vector<ivec4> Quad;
-
+    CPU_SCOPE("Ground");
     diffuseColor = vec3(0.3, 0.2, 0.1);
     specularColor = vec3(1.0, 1.0, 1.0);
     shininess = 120.0;
@@ -624,7 +674,11 @@ Ground::Ground(const float r, const int n)
                                       (i  )*(n+1) + (j),
                                       (i  )*(n+1) + (j-1))); } } }
 
-    vao = VaoFromQuads(Pnt, Nrm, Tex, Tan, Quad);
-    count = Quad.size();
-    shape = 4;
+    OptimizeMesh(*this, "Ground");
+    ComputeSize();
+    MakeVAO();
+
+    lodPixels = n*LOD_PIXELS_PER_SEGMENT;
+    for (int k=1, m=n/2;  k<levels && k<MAX_LODS && m>=1;  k++, m/=2)
+        lods.push_back(new Ground(r, m));
 }
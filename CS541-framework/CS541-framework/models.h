@@ -1,9 +1,9 @@
 ////////////////////////////////////////////////////////////////////////
 // A small library of object shapes (ground plane, sphere, and the
-// famous Utah teapot), each created as a batch of Vertex Buffer
-// Objects collected under a Vertex Array Object umbrella.  This is
-// the latest and most efficient way to get geometry into the OpenGL
-// graphics pipeline.
+// famous Utah teapot), each created as one interleaved Vertex Buffer
+// Object (and an index buffer) under a Vertex Array Object umbrella,
+// by a VertexBuilder (vertexbuffer.h).  This is the latest and most
+// efficient way to get geometry into the OpenGL graphics pipeline.
 //
 // Each vertex is specified as four attributes which are made
 // available in a vertes shader in the following attribute slots.
@@ -13,12 +13,40 @@
 // texture coord,   vec3,   attribute #2
 // tangent,         vec3,   attribute #3
 //
-// An instance of any of these shapes is create with a single call:
-//    unsigned int obj = CreateSphere(divisions, &quadCount);
+// With Model::quantizeVertices set (the default), MakeVAO stores them
+// packed instead (see vertexbuffer.h):  Positions in 16 bits per
+// coordinate relative to the model's bounds, normals and tangents in
+// 10, and texture coordinates in 16 if they are all within [0,1] (or
+// else left as floats:  packing), with positionDecode (center and
+// scale) for the vertex shader to undo the positions' packing.  Indices are
+// 16 bits (indexType) when there are few enough vertices.
+//
+// Instanced drawing (Model::DrawInstanced) additionally supplies one
+// InstanceData record per instance in the following slots.
+//
+// model matrix,    mat4,   attributes #4-#7
+// normal matrix,   mat3,   attributes #8-#10
+// diffuse color,   vec3,   attribute #11
+//
+// The procedural shapes can also build a chain of coarser levels of
+// detail (LODs), each halving the tessellation:  Sphere(32, 4) holds
+// Sphere(16), Sphere(8) and Sphere(4) as Level(1) to Level(3).  Each
+// level records the largest projected diameter (in pixels) at which
+// its facets stay about LOD_PIXELS_PER_SEGMENT pixels long, and
+// SelectLod picks a level from a projected size.  Ply models have no
+// tessellation to halve, and instead simplify their own triangles:
+// Ply("bunny.ply", false, 4) keeps a quarter of the triangles at each
+// coarser level.  Levels of MESHLET_MIN_TRIANGLES or more are also cut
+// into meshlets (meshlet.h), culled piecewise.
+//
+// An instance of any of these shapes is created with a single call:
+//    Model* sphere = new Sphere(divisions);
 // and drawn by:
-//    glBindVertexArray(obj);
-//    glDrawElements(GL_QUADS, quadCount, GL_UNSIGNED_INT, 0);
+//    glBindVertexArray(sphere->vao);
+//    glDrawElements(GL_TRIANGLES, 3*sphere->count, sphere->indexType, 0);
 //    glBindVertexArray(0);
+// (the index type being GL_UNSIGNED_SHORT for small packed models), or
+// simply by sphere->DrawVAO().
 //
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
@@ -35,12 +63,44 @@ using namespace glm;
 
 #include <vector>
 
+// Target length on screen of a tessellation segment, in pixels.
+const float LOD_PIXELS_PER_SEGMENT = 8.0f;
+
+// Most levels a model's LOD chain may have (including itself).
+const int MAX_LODS = 4;
+
+// Default share of the triangles of the level before that each level
+// simplified from a mesh (see simplify.h) keeps.
+const float LOD_TRIANGLE_RATIO = 0.25f;
+
+// Per-instance data for instanced drawing;  Its layout must match
+// the instance attribute slots listed above.
+struct InstanceData
+{
+    mat4 modelTr;
+    mat3 normalTr;
+    vec3 diffuseColor;
+};
+
+// Attach the instance attributes (slots #4-#11) of the currently bound
+// VAO to an array buffer of InstanceData records.
+void BindInstanceAttributes(const unsigned int buffer);
+
+// How MakeVAO stored a model's vertices:  As floats, packed, or packed
+// but for texture coordinates outside [0,1], which stay floats.
+enum VertexPacking { PACK_NONE, PACK_ALL, PACK_FLOAT_TEXCOORDS };
+
+class MeshPool;
+class Meshlets;
+
 class Model
 {
 public:
 
-    Model() :animate(false) {}
-    virtual ~Model() {}
+    Model() :animate(false), lodPixels(0.0f), simplified(false), vao(0), indexType(0), packing(PACK_NONE),
+             positionDecode(0.0f, 0.0f, 0.0f, 1.0f), instanceBuffer(0),
+             instanceCount(0), pool(NULL), meshlets(NULL) {}
+    virtual ~Model();
 
     // Data arrays
     std::vector<vec4> Pnt;
@@ -52,7 +112,8 @@ public:
     vec3 diffuseColor, specularColor;
     float shininess;
 
-    // Geometry defined by indices into data arrays
+    // Geometry defined by indices into data arrays;  Quads are split
+    // into triangles (OptimizeMesh) before the VAO is made.
     std::vector<ivec4> Quad;
     std::vector<ivec3> Tri;
     unsigned int count;
@@ -62,39 +123,83 @@ public:
     vec3 minP, maxP;
     vec3 center;
     float size;
+    float radius;       // Of a bounding sphere around center
     mat4 modelTr;
     bool animate;
 
-    // Defined by MakeVAO when/if sending to OpenGL
+    // Coarser levels of detail (owned by this model), the largest
+    // projected diameter, in pixels, this level is meant for, and
+    // whether this level was simplified from a finer one (simplify.h),
+    // and so may cut across concave parts of the surface.
+    std::vector<Model*> lods;
+    float lodPixels;
+    bool simplified;
+    int Levels() const { return 1 + (int)lods.size(); }
+    Model* Level(const int i) { return i == 0 ? this : lods[i-1]; }
+    int SelectLod(const float pixels, int current) const;
+
+    // Defined by MakeVAO when/if sending to OpenGL:  The VAO, its
+    // index type (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT), and how its
+    // vertices are packed, with positions (if packed at all) decoded as
+    // P*positionDecode.w + positionDecode.xyz.
     unsigned int vao;
+    unsigned int indexType;
+    VertexPacking packing;
+    vec4 positionDecode;
+    static bool quantizeVertices;
+
+    // Defined by SetInstances for DrawInstanced
+    unsigned int instanceBuffer;
+    unsigned int instanceCount;
+
+    // Defined by MeshPool::Add when the model's geometry has been
+    // copied into a shared pool:  Its triangles' range of the pool's
+    // index buffer, and the offset added to its vertex indices.
+    MeshPool* pool;
+    unsigned int poolFirstIndex, poolIndexCount, poolBaseVertex;
+
+    // Clusters of the triangles, for culling parts of large models
+    // (meshlet.h), or NULL to draw the model whole;  Owned.
+    Meshlets* meshlets;
 
     virtual void ComputeSize();
+    void WorldBox(const mat4& tr, vec3& boxCenter, vec3& boxExtent) const;
+    void WorldSphere(const mat4& tr, vec3& sphereCenter, float& sphereRadius) const;
     virtual void MakeVAO();
     virtual void DrawVAO();
+    virtual void SetInstances(const InstanceData* data, const int n);
+    void UpdateInstances(const InstanceData* data, const int first, const int n);
+    virtual void DrawInstanced();
+
+    // Draw calls without the VAO bind/unbind, for callers (such as
+    // RenderQueue) that manage the VAO binding themselves.
+    void DrawElements();
+    void DrawElementsInstanced();
 };
 
 class Sphere: public Model
 {
 public:
-    Sphere(const int n);
+    Sphere(const int n, const int levels=1);
 };
 
 class Teapot: public Model
 {
 public:
-    Teapot(const int n);
+    Teapot(const int n, const int levels=1);
 };
 
 class Ground: public Model
 {
 public:
-    Ground(const float range, const int n);
+    Ground(const float range, const int n, const int levels=1);
 };
 
 class Ply: public Model
 {
 public:
-    Ply(const char* name, const bool reverse=false);
+    Ply(const char* name, const bool reverse=false, const int levels=1,
+        const float lodRatio=LOD_TRIANGLE_RATIO);
     virtual ~Ply() {printf("destruct Ply\n");};
     static int vertex_cb(p_ply_argument argument);
     static int face_cb(p_ply_argument argument);
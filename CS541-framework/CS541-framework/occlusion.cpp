@@ -0,0 +1,380 @@
+///////////////////////////////////////////////////////////////////////
+// Software occlusion culling:  A multi-threaded CPU depth rasterizer
+// for occluder proxies, a min/max depth pyramid, and box tests against
+// it.  See occlusion.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define OCCLUSION_SSE
+#endif
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#include "occlusion.h"
+#include "workers.h"
+#include "cputrace.h"
+
+////////////////////////////////////////////////////////////////////////
+// Bucket a model's vertices into a grid of cubic cells.
+void OccluderProxy::BuildGrid(VertexGrid& grid, const Model* m, const float cell)
+{
+    grid.model = m;
+    grid.cell = cell;
+    vec3 hi = vec3(m->Pnt[0]);
+    grid.lo = hi;
+    for (unsigned int i=0;  i<m->Pnt.size();  i++) {
+        grid.lo = min(grid.lo, vec3(m->Pnt[i]));
+        hi = max(hi, vec3(m->Pnt[i])); }
+    grid.dim = ivec3((hi-grid.lo)/cell) + ivec3(1);
+
+    // Counting sort by cell:  Cell k's vertices are index[first[k]]
+    // to index[first[k+1]].
+    grid.first.assign(grid.dim.x*grid.dim.y*grid.dim.z + 1, 0);
+    std::vector<int> cellOf(m->Pnt.size());
+    for (unsigned int i=0;  i<m->Pnt.size();  i++) {
+        ivec3 c = min(ivec3((vec3(m->Pnt[i])-grid.lo)/cell), grid.dim-ivec3(1));
+        cellOf[i] = (c.z*grid.dim.y + c.y)*grid.dim.x + c.x;
+        grid.first[cellOf[i]+1]++; }
+    for (unsigned int k=1;  k<grid.first.size();  k++)
+        grid.first[k] += grid.first[k-1];
+    std::vector<int> fill(grid.first.begin(), grid.first.end()-1);
+    grid.index.resize(m->Pnt.size());
+    for (unsigned int i=0;  i<m->Pnt.size();  i++)
+        grid.index[fill[cellOf[i]]++] = i;
+}
+
+////////////////////////////////////////////////////////////////////////
+// How far p lies outside the model's surface, as measured by the
+// tangent plane of its nearest vertex (negative inside).  The nearest
+// is searched for in the 27 cells around p, which is exact when one is
+// found within a cell's width, and among all vertices otherwise.
+float OccluderProxy::Outside(const VertexGrid& grid, const vec3& p)
+{
+    const Model* m = grid.model;
+    ivec3 c = ivec3(floor((p-grid.lo)/grid.cell));
+    int best = -1;
+    float bestD = 0.0f;
+    for (int z=max(c.z-1, 0);  z<=min(c.z+1, grid.dim.z-1);  z++)
+        for (int y=max(c.y-1, 0);  y<=min(c.y+1, grid.dim.y-1);  y++)
+            for (int x=max(c.x-1, 0);  x<=min(c.x+1, grid.dim.x-1);  x++) {
+                int k = (z*grid.dim.y + y)*grid.dim.x + x;
+                for (int j=grid.first[k];  j<grid.first[k+1];  j++) {
+                    float d = length(p - vec3(m->Pnt[grid.index[j]]));
+                    if (best < 0 || d < bestD) {
+                        best = grid.index[j];
+                        bestD = d; } } }
+    if (best < 0 || bestD > grid.cell)
+        for (unsigned int i=0;  i<m->Pnt.size();  i++) {
+            float d = length(p - vec3(m->Pnt[i]));
+            if (best < 0 || d < bestD) {
+                best = i;
+                bestD = d; } }
+    if (length(m->Nrm[best]) == 0.0f)
+        return bestD;           // No plane;  Only on the vertex is surely inside.
+    return dot(p - vec3(m->Pnt[best]), normalize(m->Nrm[best]));
+}
+
+////////////////////////////////////////////////////////////////////////
+// Build the proxy from the model's coarsest level of detail (already
+// triangulated by MakeVAO), and shrink it inside the finest level (see
+// occlusion.h).  A model too detailed even at its coarsest level, or
+// whose coarsest level was simplified (and so may bridge concave parts
+// of the surface by far more than its vertices can move), or without
+// normals to shrink along, gets an empty proxy, and so occludes nothing.
+void OccluderProxy::FromModel(Model* m)
+{
+    Pnt.clear();
+    Tri.clear();
+    Model* c = m->Level(m->Levels()-1);
+    if (c->simplified || c->Tri.size() > (unsigned int)MAX_PROXY_TRIANGLES)
+        return;
+
+    for (unsigned int i=0;  i<c->Pnt.size();  i++)
+        Pnt.push_back(vec3(c->Pnt[i]));
+    const std::vector<ivec3>& tris = c->Tri;
+    if (c == m) {               // The model itself is exact.
+        Tri = tris;
+        return; }
+    if (m->Nrm.size() != m->Pnt.size() || c->Nrm.size() != c->Pnt.size() || m->Tri.empty()) {
+        Pnt.clear();
+        return; }
+
+    float edge = 0.0f;
+    for (unsigned int t=0;  t<m->Tri.size();  t++)
+        for (int k=0;  k<3;  k++)
+            edge += length(vec3(m->Pnt[m->Tri[t][k]] - m->Pnt[m->Tri[t][(k+1)%3]]));
+    edge /= 3*m->Tri.size();
+    VertexGrid grid;
+    BuildGrid(grid, m, 2.0f*edge);
+
+    // The farthest outside any facet strays, then every vertex pushed
+    // in by that much plus the margin
+    float depth = 0.0f;
+    for (int pass=0;  pass<2;  pass++) {
+        for (unsigned int t=0;  t<tris.size();  t++) {
+            float out = 0.0f;
+            for (int i=0;  i<=PROXY_SAMPLES;  i++)
+                for (int j=0;  i+j<=PROXY_SAMPLES;  j++) {
+                    int k = PROXY_SAMPLES-i-j;
+                    vec3 p = (float(i)*Pnt[tris[t][0]] + float(j)*Pnt[tris[t][1]]
+                              + float(k)*Pnt[tris[t][2]])/float(PROXY_SAMPLES);
+                    out = max(out, Outside(grid, p)); }
+            if (pass == 0)
+                depth = max(depth, out);
+            else if (out <= 0.0f)
+                Tri.push_back(tris[t]); }
+
+        if (pass == 0)
+            for (unsigned int i=0;  i<Pnt.size();  i++)
+                if (length(c->Nrm[i]) > 0.0f)
+                    Pnt[i] -= (depth + PROXY_MARGIN*edge)*normalize(c->Nrm[i]); }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Start a frame:  Size the buffer for the viewport, clear it to the
+// far plane, and forget last frame's occluders.
+void OcclusionBuffer::Begin(const mat4& PV, const int viewWidth, const int viewHeight)
+{
+    projView = PV;
+    width = OCCLUSION_WIDTH;
+    height = viewHeight > 0 && viewWidth > 0 ? width*viewHeight/viewWidth : width/2;
+    if (height < 1) height = 1;
+    stride = (width+3) & ~3;
+
+    if (levels.empty() || levels[0].width != width || levels[0].height != height) {
+        levels.clear();
+        int w = width, h = height;
+        while (true) {
+            Level l;
+            l.width = w;
+            l.height = h;
+            l.minZ.resize((levels.empty() ? stride : w)*h);
+            l.maxZ.resize((levels.empty() ? stride : w)*h);
+            levels.push_back(l);
+            if (w == 1 && h == 1) break;
+            w = (w+1)/2;
+            h = (h+1)/2; } }
+
+    std::fill(levels[0].maxZ.begin(), levels[0].maxZ.end(), 1.0f);
+    tris.clear();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Transform a proxy to clip space, clip its triangles against the near
+// plane, and set them up for rasterization.
+void OcclusionBuffer::AddOccluder(const OccluderProxy& proxy, const mat4& modelTr)
+{
+    mat4 M = projView*modelTr;
+    std::vector<vec4> clip(proxy.Pnt.size());
+    for (unsigned int i=0;  i<proxy.Pnt.size();  i++)
+        clip[i] = M*vec4(proxy.Pnt[i], 1.0f);
+
+    for (unsigned int t=0;  t<proxy.Tri.size();  t++) {
+        vec4 in[3] = { clip[proxy.Tri[t][0]], clip[proxy.Tri[t][1]], clip[proxy.Tri[t][2]] };
+
+        // Clip against z >= -w (the near plane);  A triangle becomes at
+        // most a quad, drawn as a fan.
+        vec4 out[4];
+        int n = 0;
+        for (int i=0;  i<3;  i++) {
+            const vec4& a = in[i];
+            const vec4& b = in[(i+1)%3];
+            float da = a.z + a.w;
+            float db = b.z + b.w;
+            if (da >= 0.0f)
+                out[n++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                out[n++] = a + (b-a)*(da/(da-db)); }
+
+        for (int i=1;  i+1<n;  i++) {
+            vec4 v[3] = { out[0], out[i], out[i+1] };
+            SetupTriangle(v); } }
+}
+
+// Project a clipped triangle to the screen and compute its edge
+// functions, depth plane and bounding rectangle.  Both windings are
+// kept, since occluders hide things whichever side faces the eye.
+void OcclusionBuffer::SetupTriangle(const vec4* v)
+{
+    float x[3], y[3], z[3];
+    for (int i=0;  i<3;  i++) {
+        float w = v[i].w > 1e-6f ? v[i].w : 1e-6f;
+        x[i] = (v[i].x/w*0.5f + 0.5f)*width;
+        y[i] = (v[i].y/w*0.5f + 0.5f)*height;
+        z[i] = v[i].z/w*0.5f + 0.5f; }
+
+    float area = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+    if (fabs(area) < 1e-8f) return;
+    if (area < 0.0f) {
+        std::swap(x[1], x[2]);  std::swap(y[1], y[2]);  std::swap(z[1], z[2]);
+        area = -area; }
+
+    Triangle t;
+    t.minX = max(0, (int)floor(min(x[0], min(x[1], x[2]))));
+    t.maxX = min(width-1, (int)ceil(max(x[0], max(x[1], x[2]))));
+    t.minY = max(0, (int)floor(min(y[0], min(y[1], y[2]))));
+    t.maxY = min(height-1, (int)ceil(max(y[0], max(y[1], y[2]))));
+    if (t.minX > t.maxX || t.minY > t.maxY) return;
+
+    // Edge i runs from vertex i to vertex i+1;  Positive to its left.
+    for (int i=0;  i<3;  i++) {
+        int j = (i+1)%3;
+        t.A[i] = y[i] - y[j];
+        t.B[i] = x[j] - x[i];
+        t.C[i] = x[i]*y[j] - x[j]*y[i]; }
+
+    t.dzdx = ((z[1]-z[0])*(y[2]-y[0]) - (z[2]-z[0])*(y[1]-y[0]))/area;
+    t.dzdy = ((x[1]-x[0])*(z[2]-z[0]) - (x[2]-x[0])*(z[1]-z[0]))/area;
+    t.z0 = z[0] - t.dzdx*x[0] - t.dzdy*y[0];
+    tris.push_back(t);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Fill all triangles into the depth buffer, one band of rows per job,
+// then build the pyramid.
+void OcclusionBuffer::BandJob(int index, int, void* data)
+{
+    OcclusionBuffer* b = (OcclusionBuffer*)data;
+    int y0 = index*b->bandHeight;
+    b->RasterizeBand(y0, min(y0+b->bandHeight, b->height));
+}
+
+void OcclusionBuffer::Rasterize()
+{
+    int bands = 2*workers.Threads();
+    bandHeight = (height+bands-1)/bands;
+    bands = (height+bandHeight-1)/bandHeight;
+    workers.Run(bands, BandJob, this);
+    BuildPyramid();
+}
+
+// Rasterize rows [y0,y1), keeping the nearest depth at each pixel
+// center covered by a triangle.
+void OcclusionBuffer::RasterizeBand(const int y0, const int y1)
+{
+    CPU_SCOPE("RasterizeBand");
+    float* depth = &levels[0].maxZ[0];
+
+    for (unsigned int k=0;  k<tris.size();  k++) {
+        const Triangle& t = tris[k];
+        int ya = max(t.minY, y0);
+        int yb = min(t.maxY, y1-1);
+
+        for (int y=ya;  y<=yb;  y++) {
+            float py = y + 0.5f;
+            float* row = depth + y*stride;
+            float e[3];
+            for (int i=0;  i<3;  i++)
+                e[i] = t.B[i]*py + t.C[i];
+            float zr = t.dzdy*py + t.z0;
+            int x = t.minX & ~3;
+
+#ifdef OCCLUSION_SSE
+            {
+                const __m128 zero = _mm_setzero_ps();
+                __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3, 2, 1, 0));
+                const __m128 four = _mm_set1_ps(4.0f);
+                __m128 A0 = _mm_set1_ps(t.A[0]), A1 = _mm_set1_ps(t.A[1]), A2 = _mm_set1_ps(t.A[2]);
+                __m128 E0 = _mm_set1_ps(e[0]), E1 = _mm_set1_ps(e[1]), E2 = _mm_set1_ps(e[2]);
+                __m128 DZ = _mm_set1_ps(t.dzdx), ZR = _mm_set1_ps(zr);
+
+                for ( ;  x<=t.maxX;  x+=4, px=_mm_add_ps(px, four)) {
+                    __m128 in = _mm_and_ps(
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(A0, px), E0), zero),
+                        _mm_and_ps(
+                            _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(A1, px), E1), zero),
+                            _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(A2, px), E2), zero)));
+                    if (_mm_movemask_ps(in) == 0) continue;
+                    __m128 z = _mm_add_ps(_mm_mul_ps(DZ, px), ZR);
+                    __m128 old = _mm_loadu_ps(&row[x]);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(in, nearer),
+                                                     _mm_andnot_ps(in, old))); }
+            }
+#else
+            for ( ;  x<=t.maxX;  x++) {
+                float px = x + 0.5f;
+                if (t.A[0]*px + e[0] >= 0.0f && t.A[1]*px + e[1] >= 0.0f
+                    && t.A[2]*px + e[2] >= 0.0f) {
+                    float z = t.dzdx*px + zr;
+                    if (z < row[x]) row[x] = z; } }
+#endif
+        } }
+}
+
+// Each texel of a level holds the minimum and maximum depth of the
+// (up to) 2x2 texels under it in the level below.
+void OcclusionBuffer::BuildPyramid()
+{
+    Level& base = levels[0];
+    for (int y=0;  y<height;  y++)
+        for (int x=0;  x<width;  x++)
+            base.minZ[y*stride+x] = base.maxZ[y*stride+x];
+
+    for (unsigned int l=1;  l<levels.size();  l++) {
+        const Level& s = levels[l-1];
+        Level& d = levels[l];
+        int sw = l == 1 ? stride : s.width;
+        for (int y=0;  y<d.height;  y++)
+            for (int x=0;  x<d.width;  x++) {
+                float lo = FLT_MAX, hi = -FLT_MAX;
+                for (int j=2*y;  j<min(2*y+2, s.height);  j++)
+                    for (int i=2*x;  i<min(2*x+2, s.width);  i++) {
+                        lo = min(lo, s.minZ[j*sw+i]);
+                        hi = max(hi, s.maxZ[j*sw+i]); }
+                d.minZ[y*d.width+x] = lo;
+                d.maxZ[y*d.width+x] = hi; } }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Test a world-space box.  Its screen rectangle (grown by a texel, to
+// cover pixels the occluders only partly fill) is looked up at the
+// pyramid level where it spans at most a couple of texels;  The box is
+// hidden if its nearest depth is behind the farthest depth stored in
+// all of them.  Boxes crossing the near plane always pass.
+bool OcclusionBuffer::TestBox(const vec3& center, const vec3& extent) const
+{
+    if (tris.empty()) return true;
+
+    float xmin = FLT_MAX, xmax = -FLT_MAX, ymin = FLT_MAX, ymax = -FLT_MAX;
+    float zmin = FLT_MAX;
+    for (int i=0;  i<8;  i++) {
+        vec3 p = center + extent*vec3(i&1 ? 1.0f : -1.0f, i&2 ? 1.0f : -1.0f,
+                                      i&4 ? 1.0f : -1.0f);
+        vec4 c = projView*vec4(p, 1.0f);
+        if (c.z < -c.w || c.w <= 0.0f)
+            return true;
+        float x = (c.x/c.w*0.5f + 0.5f)*width;
+        float y = (c.y/c.w*0.5f + 0.5f)*height;
+        xmin = min(xmin, x);  xmax = max(xmax, x);
+        ymin = min(ymin, y);  ymax = max(ymax, y);
+        zmin = min(zmin, c.z/c.w*0.5f + 0.5f); }
+
+    // Quick accept:  Nearer than every occluder
+    const Level& top = levels.back();
+    if (zmin <= top.minZ[0])
+        return true;
+
+    int x0 = max(0, (int)floor(xmin)-1);
+    int x1 = min(width-1, (int)floor(xmax)+1);
+    int y0 = max(0, (int)floor(ymin)-1);
+    int y1 = min(height-1, (int)floor(ymax)+1);
+    if (x0 > x1 || y0 > y1)
+        return true;            // Off screen;  Left to the frustum test
+
+    int l = 0;
+    while (l+1 < (int)levels.size() && max(x1-x0, y1-y0) >> l > 1)
+        l++;
+    const Level& L = levels[l];
+    int w = l == 0 ? stride : L.width;
+    for (int y=y0>>l;  y<=y1>>l;  y++)
+        for (int x=x0>>l;  x<=x1>>l;  x++)
+            if (zmin <= L.maxZ[y*w+x])
+                return true;
+    return false;
+}
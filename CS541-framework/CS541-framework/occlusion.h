@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////
+// Software occlusion culling.  A few large objects (the occluders) are
+// drawn as low-poly proxies into a small CPU depth buffer, from which
+// a pyramid of per-texel minimum and maximum depths (Hi-Z) is built.
+// Other objects' bounding boxes are then tested against the pyramid:
+// A box whose nearest depth lies behind the farthest occluder depth
+// over its whole screen footprint is hidden and needn't be drawn.
+//
+// Everything runs on the CPU;  No OpenGL is involved.  Rasterization
+// is split into horizontal bands run on the worker pool (workers.h),
+// each band filling four pixels at a time with SSE where available.
+//
+// Usage, each frame:
+//    occlusion.Begin(projView, width, height);
+//    occlusion.AddOccluder(proxy, modelTr);  ...
+//    occlusion.Rasterize();
+//    ... occlusion.TestBox(center, extent) from any thread ...
+//
+// Proxies must lie inside the objects they stand for for the test to
+// be conservative.  A coarse LOD's vertices lie on the surface, but
+// its facets bridge concave parts outside it, so FromModel pushes them
+// inward (see OccluderProxy) and drops any facet still found outside.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _OCCLUSION
+#define _OCCLUSION
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+using namespace glm;
+
+// Width of the depth buffer;  Its height follows the viewport's aspect.
+const int OCCLUSION_WIDTH = 256;
+
+// Proxies larger than this aren't worth rasterizing.
+const int MAX_PROXY_TRIANGLES = 4096;
+
+// Points per facet edge (less one) tested against the finest level,
+// and slack for that level's own facets, in its mean edge lengths.
+const int PROXY_SAMPLES = 4;
+const float PROXY_MARGIN = 0.25f;
+
+// Occluder geometry:  The triangles of a model's coarsest level
+// (unless simplified;  See Model::simplified), shrunk to lie inside
+// the model:  Points sampled on each facet are measured against the
+// tangent plane of the nearest vertex of the finest level, every
+// vertex moves in along its normal by the farthest any lies outside
+// (plus PROXY_MARGIN), and facets still found outside are dropped.
+struct OccluderProxy
+{
+    std::vector<vec3> Pnt;
+    std::vector<ivec3> Tri;
+
+    void FromModel(Model* m);
+
+private:
+    // The finest level's vertices in a grid of cells, for Outside
+    struct VertexGrid
+    {
+        const Model* model;
+        vec3 lo;
+        float cell;
+        ivec3 dim;
+        std::vector<int> first, index;
+    };
+    static void BuildGrid(VertexGrid& grid, const Model* m, const float cell);
+    static float Outside(const VertexGrid& grid, const vec3& p);
+};
+
+class OcclusionBuffer
+{
+public:
+    OcclusionBuffer() :width(0), height(0), stride(0) {}
+
+    int width, height;
+
+    void Begin(const mat4& projView, const int viewWidth, const int viewHeight);
+    void AddOccluder(const OccluderProxy& proxy, const mat4& modelTr);
+    void Rasterize();
+
+    // Returns false if the world-space box is certainly hidden.
+    bool TestBox(const vec3& center, const vec3& extent) const;
+
+private:
+    // A screen-space triangle with its bounding rectangle, edge
+    // functions (inside where all three are >= 0) and depth plane.
+    struct Triangle
+    {
+        int minX, maxX, minY, maxY;
+        float A[3], B[3], C[3];
+        float z0, dzdx, dzdy;
+    };
+
+    // One level of the pyramid;  Level 0 is the depth buffer itself.
+    struct Level
+    {
+        int width, height;
+        std::vector<float> minZ, maxZ;
+    };
+
+    mat4 projView;
+    int stride;                 // Row length of level 0, padded for SIMD
+    std::vector<Triangle> tris;
+    std::vector<Level> levels;
+    int bandHeight;
+
+    void SetupTriangle(const vec4* v);
+    void RasterizeBand(const int y0, const int y1);
+    void BuildPyramid();
+    static void BandJob(int index, int thread, void* data);
+};
+
+#endif
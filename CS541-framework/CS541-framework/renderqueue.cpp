@@ -0,0 +1,400 @@
+///////////////////////////////////////////////////////////////////////
+// A per-frame queue of draw requests, sorted on a packed 64-bit key
+// and submitted with a minimum of OpenGL state changes.  See
+// renderqueue.h for the key layout.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include <glload/gl_4_3.h>
+#include <glload/gl_load.hpp>
+
+#include "renderqueue.h"
+#include "gpuprofiler.h"
+#include "cputrace.h"
+
+static const int uModelMatrix = UniformId("ModelMatrix");
+static const int uNormalMatrix = UniformId("NormalMatrix");
+static const int uPhongDiffuse = UniformId("phongDiffuse");
+static const int uPhongSpecular = UniformId("phongSpecular");
+static const int uPhongShininess = UniformId("phongShininess");
+static const int uInstanced = UniformId("instanced");
+static const int uMultiDraw = UniformId("multiDraw");
+static const int uDrawBase = UniformId("drawBase");
+static const int uDrawData = UniformId("drawData");
+static const int uPositionDecode = UniformId("positionDecode");
+
+static const int gMultiDraw = GpuScopeId("Multi-draws");
+
+// Texture unit of the multi-draw per-draw data, and its size in texels
+// (vec4s) per draw;  Must match lighting.vert.
+static const int DRAW_DATA_UNIT = 8;
+static const int DRAW_DATA_TEXELS = 9;
+
+RenderItem::RenderItem()
+    :shader(NULL), features(0), model(NULL), instanced(false),
+     modelTr(1.0f), normalTr(1.0f),
+     diffuseColor(0.0f), specularColor(0.0f), shininess(1.0f),
+     textureCount(0), layer(LAYER_OPAQUE), depth(0.0f), firstRange(0), rangeCount(-1),
+     gpuScope(-1)
+{
+}
+
+// A small hash (FNV-1a) used to squeeze a value into a few key bits.
+// Collisions only cost sort quality;  Flush compares the real state.
+static unsigned int Hash(const void* data, const int bytes)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned int h = 2166136261u;
+    for (int i=0;  i<bytes;  i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+// Start a new frame, with one recording list for each of threads
+// threads.  The view transformation is used to compute each item's
+// depth for sorting.
+void RenderQueue::Begin(const mat4& viewTr, const int threads)
+{
+    view = viewTr;
+    if ((int)lists.size() < threads)
+        lists.resize(threads);
+    for (unsigned int t=0;  t<lists.size();  t++) {
+        lists[t].items.clear();
+        lists[t].entries.clear();
+        lists[t].ranges.clear(); }
+}
+
+// Record an item on the list of the given thread.  Only that thread
+// may touch the list until Prepare.
+void RenderQueue::Add(const RenderItem& item, const int thread)
+{
+    ItemList& list = lists[thread];
+    list.items.push_back(item);
+    RenderItem& it = list.items.back();
+    vec4 c = view*(it.modelTr*vec4(it.model->center, 1.0f));
+    it.depth = -c.z;
+
+    SortEntry e;
+    e.key = MakeKey(it);
+    e.list = thread;
+    e.index = list.items.size()-1;
+    list.entries.push_back(e);
+}
+
+unsigned long long RenderQueue::MakeKey(const RenderItem& item) const
+{
+    typedef unsigned long long u64;
+
+    // Positive floats order the same as their bit patterns, so the top
+    // bits of the pattern make a monotonic 20 bit depth.
+    float d = item.depth > 0.0f ? item.depth : 0.0f;
+    unsigned int bits;
+    memcpy(&bits, &d, sizeof(bits));
+    u64 depth = bits >> 11;
+    if (item.layer >= LAYER_TRANSPARENT)
+        depth = 0xFFFFF - depth;  // Back to front
+
+    u64 layer = item.layer & 0x3;
+    unsigned int variant[2] = { (unsigned int)item.shader->program, item.features };
+    u64 program = Hash(variant, sizeof(variant)) & 0xFF;
+    u64 vao = item.model->vao & 0xFFF;
+    u64 textures = Hash(item.textures, item.textureCount*sizeof(TextureBinding)) & 0xFFF;
+    float material[7] = {
+        item.diffuseColor[0], item.diffuseColor[1], item.diffuseColor[2],
+        item.specularColor[0], item.specularColor[1], item.specularColor[2],
+        item.shininess };
+    u64 mat = Hash(material, sizeof(material)) & 0x3FF;
+
+    if (frontToBack || item.layer >= LAYER_TRANSPARENT)
+        return layer<<62 | depth<<42 | program<<34 | textures<<22 | vao<<10 | mat;
+    else
+        return layer<<62 | program<<54 | textures<<42 | vao<<30 | mat<<20 | depth;
+}
+
+// LSD radix sort of (key,index) pairs, one byte per pass.  Passes in
+// which all keys share the same byte are skipped.
+void RenderQueue::Sort()
+{
+    const int n = order.size();
+    scratch.resize(n);
+    if (n < 2) return;
+
+    for (int shift=0;  shift<64;  shift+=8) {
+        unsigned int count[256] = {0};
+        for (int i=0;  i<n;  i++)
+            count[(order[i].key>>shift) & 0xFF]++;
+        if (count[(order[0].key>>shift) & 0xFF] == (unsigned int)n)
+            continue;
+
+        unsigned int sum = 0;
+        for (int b=0;  b<256;  b++) {
+            unsigned int c = count[b];
+            count[b] = sum;
+            sum += c; }
+        for (int i=0;  i<n;  i++)
+            scratch[count[(order[i].key>>shift) & 0xFF]++] = order[i];
+        order.swap(scratch); }
+}
+
+// Merge the per-thread lists and sort them.  Called once all
+// recording threads are done.
+void RenderQueue::Prepare()
+{
+    CPU_SCOPE("RenderQueue::Prepare");
+    order.clear();
+    for (unsigned int t=0;  t<lists.size();  t++)
+        order.insert(order.end(), lists[t].entries.begin(), lists[t].entries.end());
+    Sort();
+}
+
+// Multi-draw needs glMultiDrawElementsIndirect (OpenGL 4.3) and
+// gl_DrawIDARB in the shader.  Checked once.
+bool RenderQueue::MultiDrawSupported()
+{
+    if (multiDrawState < 0)
+        multiDrawState = glload::IsVersionGEQ(4, 3)
+                         && glext_ARB_shader_draw_parameters ? 1 : 0;
+    return multiDrawState == 1;
+}
+
+// Can items a and b be drawn by the same multi-draw?
+static bool SameBatch(const RenderItem& a, const RenderItem& b)
+{
+    return a.shader == b.shader
+        && a.features == b.features
+        && a.textureCount == b.textureCount
+        && memcmp(a.textures, b.textures, a.textureCount*sizeof(TextureBinding)) == 0
+        && a.specularColor == b.specularColor
+        && a.shininess == b.shininess;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Group the sorted pooled items into batches, and build each item's
+// indirect command and per-draw data.  Instanced items read their
+// instances from the pool's instance buffer, so their model's
+// instances are scheduled to be copied there.
+void RenderQueue::BuildBatches()
+{
+    batches.clear();
+    commands.clear();
+    drawData.clear();
+    copies.clear();
+    int instances = 0;
+
+    for (unsigned int i=0;  i<order.size();  i++) {
+        const RenderItem& it = Item(i);
+        if (it.model->pool != pool || it.rangeCount >= 0) continue;
+
+        if (batches.empty()
+            || batches.back().first+batches.back().count != (int)i
+            || !SameBatch(Item(batches.back().first), it)) {
+            Batch b = { (int)i, 0, (int)commands.size() };
+            batches.push_back(b); }
+        batches.back().count++;
+
+        IndirectCommand c;
+        c.count = it.model->poolIndexCount;
+        c.firstIndex = it.model->poolFirstIndex;
+        c.baseVertex = it.model->poolBaseVertex;
+        c.instanceCount = 1;
+        c.baseInstance = 0;
+        if (it.instanced) {
+            c.instanceCount = it.model->instanceCount;
+            c.baseInstance = instances;
+            InstanceCopy copy = { it.model->instanceBuffer, instances,
+                                  (int)it.model->instanceCount };
+            copies.push_back(copy);
+            instances += it.model->instanceCount; }
+        commands.push_back(c);
+
+        for (int col=0;  col<4;  col++)
+            drawData.push_back(it.modelTr[col]);
+        for (int col=0;  col<3;  col++)
+            drawData.push_back(it.normalTr[col]);
+        drawData.push_back(vec4(it.diffuseColor, it.instanced ? 1.0f : 0.0f));
+        drawData.push_back(it.model->positionDecode); }
+
+    pool->ReserveInstances(instances);
+}
+
+// Append every list's ranges (for partial items) to the commands.
+void RenderQueue::AddRanges()
+{
+    for (unsigned int t=0;  t<lists.size();  t++) {
+        lists[t].rangeBase = commands.size();
+        commands.insert(commands.end(), lists[t].ranges.begin(), lists[t].ranges.end()); }
+}
+
+// Send the indirect commands of batches and partial items, leaving
+// the command buffer bound.
+void RenderQueue::UploadCommands()
+{
+    if (!commandBuffer) {
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &drawDataBuffer);
+        glGenTextures(1, &drawDataTexture); }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(IndirectCommand)*commands.size(),
+                 &commands[0], GL_STREAM_DRAW);
+}
+
+// Send the per-draw data and instances for all batches.
+void RenderQueue::UploadBatches()
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4)*drawData.size(), &drawData[0],
+                 GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0+DRAW_DATA_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool->instanceBuffer);
+    for (unsigned int i=0;  i<copies.size();  i++) {
+        if (!copies[i].count) continue;
+        glBindBuffer(GL_COPY_READ_BUFFER, copies[i].buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                            sizeof(InstanceData)*copies[i].offset,
+                            sizeof(InstanceData)*copies[i].count); }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// Issue the OpenGL calls for the sorted items.
+void RenderQueue::Submit()
+{
+    CPU_SCOPE("RenderQueue::Submit");
+    draws = programChanges = textureChanges = vaoChanges = materialChanges = 0;
+
+    batches.clear();
+    commands.clear();
+    bool indirect = MultiDrawSupported();
+    if (multiDraw && pool && pool->vao && indirect)
+        BuildBatches();
+    if (indirect)
+        AddRanges();
+    if (!commands.empty())
+        UploadCommands();
+    if (!batches.empty())
+        UploadBatches();
+
+    ShaderProgram* shader = NULL;
+    unsigned int vao = 0;
+    unsigned int bound[16] = {0}; // Texture bound to each unit
+    const RenderItem* material = NULL;
+    unsigned int b = 0;           // Next batch
+    int scope = -1;               // Profiler scope now open
+
+    for (unsigned int i=0;  i<order.size();  ) {
+        const RenderItem& it = Item(i);
+        const Batch* batch = NULL;
+        if (b < batches.size() && batches[b].first == (int)i)
+            batch = &batches[b++];
+
+        int itemScope = batch ? gMultiDraw : it.gpuScope;
+        if (itemScope != scope) {
+            if (scope >= 0) gpuProfiler.End();
+            if (itemScope >= 0) gpuProfiler.Begin(itemScope);
+            scope = itemScope; }
+
+        // Variants are looked up (and compiled, the first time) here,
+        // on the OpenGL thread;  While one compiles, its program's
+        // plain variant stands in.
+        ShaderProgram* itemShader = it.shader->Usable(it.features);
+        if (itemShader != shader) {
+            shader = itemShader;
+            shader->Use();
+            material = NULL;  // Uniforms are per program
+            // Keep the buffer sampler off the units (default 0) of
+            // the other samplers, even when unused.
+            shader->SetUniform(uDrawData, DRAW_DATA_UNIT);
+            programChanges++; }
+
+        for (int t=0;  t<it.textureCount;  t++) {
+            const TextureBinding& tb = it.textures[t];
+            if (bound[tb.unit] != tb.texture) {
+                glActiveTexture(GL_TEXTURE0+tb.unit);
+                glBindTexture(GL_TEXTURE_2D, tb.texture);
+                bound[tb.unit] = tb.texture;
+                textureChanges++; }
+            shader->SetUniform(tb.sampler, tb.unit); }
+
+        if (!material
+            || it.diffuseColor != material->diffuseColor
+            || it.specularColor != material->specularColor
+            || it.shininess != material->shininess
+            || it.textureCount != material->textureCount) {
+            shader->SetUniform(uPhongDiffuse, it.diffuseColor);
+            shader->SetUniform(uPhongSpecular, it.specularColor);
+            shader->SetUniform(uPhongShininess, it.shininess);
+            material = &it;
+            materialChanges++; }
+
+        unsigned int itemVao = batch ? pool->vao : it.model->vao;
+        if (itemVao != vao) {
+            vao = itemVao;
+            glBindVertexArray(vao);
+            vaoChanges++; }
+
+        if (batch) {
+            shader->SetUniform(uMultiDraw, 1);
+            shader->SetUniform(uDrawBase, batch->base);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, pool->indexType,
+                                        (void*)(sizeof(IndirectCommand)*batch->base),
+                                        batch->count, 0);
+            draws++;
+            i += batch->count;
+            continue; }
+
+        shader->SetUniform(uMultiDraw, 0);
+        shader->SetUniform(uModelMatrix, it.modelTr);
+        shader->SetUniform(uNormalMatrix, it.normalTr);
+        shader->SetUniform(uInstanced, it.instanced ? 1 : 0);
+        shader->SetUniform(uPositionDecode, it.model->positionDecode);
+
+        if (it.instanced)
+            it.model->DrawElementsInstanced();
+        else if (it.rangeCount >= 0)
+            DrawRanges(it, lists[order[i].list]);
+        else
+            it.model->DrawElements();
+        draws++;
+        i++; }
+    if (scope >= 0) gpuProfiler.End();
+
+    if (!commands.empty())
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    if (!batches.empty()) {
+        glActiveTexture(GL_TEXTURE0+DRAW_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, 0); }
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+    if (shader) shader->Unuse();
+}
+
+// Draw a partial item's ranges of its model, from the command buffer
+// if it was uploaded.
+void RenderQueue::DrawRanges(const RenderItem& it, const ItemList& list)
+{
+    if (it.rangeCount <= 0) return;
+    if (MultiDrawSupported()) {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, it.model->indexType,
+            (void*)(sizeof(IndirectCommand)*(list.rangeBase + it.firstRange)),
+            it.rangeCount, 0);
+        return; }
+
+    unsigned int indexSize = it.model->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    rangeCounts.resize(it.rangeCount);
+    rangeOffsets.resize(it.rangeCount);
+    for (int k=0;  k<it.rangeCount;  k++) {
+        const IndirectCommand& c = list.ranges[it.firstRange+k];
+        rangeCounts[k] = c.count;
+        rangeOffsets[k] = (const void*)(size_t)(indexSize*c.firstIndex); }
+    glMultiDrawElements(GL_TRIANGLES, &rangeCounts[0], it.model->indexType,
+                        &rangeOffsets[0], it.rangeCount);
+}
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////
+// A per-frame queue of draw requests.  Instead of issuing OpenGL calls
+// directly, drawing code submits RenderItems (method "Add").  Method
+// "Flush" then sorts the items on a packed 64-bit key and submits
+// them in that order, emitting only the OpenGL state (program,
+// textures, VAO, material) that differs from the previous item.
+//
+// Items may be added from several threads at once:  Each thread passes
+// its pool thread index (see workers.h) and records into its own list,
+// computing the item's depth and key as it goes.  Flush is "Prepare"
+// (merge the lists and sort) followed by "Submit" (the OpenGL calls),
+// and only Submit needs the OpenGL context.
+//
+// Multi-draw mode (opt-in, with multiDraw set and a MeshPool given):
+// Runs of consecutive sorted items whose models live in the pool, and
+// which share program, textures and specular material, are submitted
+// with a single glMultiDrawElementsIndirect call on the pool's VAO.
+// Their per-draw values (matrices, diffuse color, instancing) go to a
+// buffer texture which the vertex shader indexes with gl_DrawIDARB.
+// This needs OpenGL 4.3 and ARB_shader_draw_parameters;  Without them
+// the mode quietly stays off.
+//
+// Partial items:  An item may draw only some ranges of its model's
+// index buffer (as left by meshlet culling;  See meshlet.h), recorded
+// with Ranges(thread) on the same thread's list.  All frame's ranges
+// go into one indirect command buffer, and each partial item is one
+// glMultiDrawElementsIndirect call, or, before OpenGL 4.3, one
+// glMultiDrawElements call.  Partial items never join multi-draws.
+//
+// While the GPU profiler (gpuprofiler.h) is on, Submit times each run
+// of consecutive items in the items' gpuScope, and each multi-draw in
+// a scope of its own, since one multi-draw may span several scopes.
+//
+// Key layout, most significant bits first:
+//    layer      2 bits   (opaque before transparent)
+//    program    8 bits   (program and variant)
+//    textures  12 bits
+//    vao       12 bits
+//    material  10 bits
+//    depth     20 bits
+// With frontToBack set, the depth field moves up to sit just below the
+// layer, so opaque geometry is drawn nearest first and early-Z rejects
+// more fragments.  Transparent items are always sorted back to front.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _RENDERQUEUE
+#define _RENDERQUEUE
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "models.h"
+#include "meshpool.h"
+
+using namespace glm;
+
+enum RenderLayer { LAYER_OPAQUE=0, LAYER_TRANSPARENT=2 };
+
+const int MAX_ITEM_TEXTURES = 2;
+
+// A single texture binding:  A texture unit and the sampler uniform
+// (a UniformId) that is told about it.
+struct TextureBinding
+{
+    int unit;
+    int sampler;
+    unsigned int texture;
+};
+
+// Everything needed to draw one model (or one instanced batch).
+struct RenderItem
+{
+    RenderItem();
+
+    ShaderProgram* shader;
+    unsigned int features;      // Variant of shader to use (see shader.h)
+    Model* model;
+    bool instanced;             // Draw the model's instances
+
+    mat4 modelTr, normalTr;
+
+    vec3 diffuseColor, specularColor;
+    float shininess;
+
+    int textureCount;           // Active entries in textures[]
+    TextureBinding textures[MAX_ITEM_TEXTURES];
+
+    int layer;
+    float depth;                // View-space distance;  Set by Add
+
+    // Not instanced only:  The entries [firstRange, firstRange +
+    // rangeCount) of Ranges(thread) to draw, or rangeCount -1 to draw
+    // the whole model.
+    int firstRange, rangeCount;
+
+    int gpuScope;               // Profiler scope to time it in, or -1
+};
+
+class RenderQueue
+{
+public:
+    RenderQueue() :frontToBack(true), multiDraw(false), pool(NULL), draws(0),
+                   programChanges(0), textureChanges(0), vaoChanges(0),
+                   materialChanges(0), multiDrawState(-1), drawDataBuffer(0),
+                   drawDataTexture(0), commandBuffer(0) {}
+
+    bool frontToBack;           // Sort opaque items on depth first
+    bool multiDraw;             // Batch pooled items into multi-draws
+    MeshPool* pool;
+
+    // Statistics for the last Flush
+    int draws;
+    int programChanges, textureChanges, vaoChanges, materialChanges;
+
+    void Begin(const mat4& viewTr, const int threads=1);
+    void Add(const RenderItem& item, const int thread=0);
+    std::vector<IndirectCommand>& Ranges(const int thread=0) { return lists[thread].ranges; }
+    void Prepare();
+    void Submit();
+    void Flush() { Prepare();  Submit(); }
+    bool MultiDrawSupported();
+
+private:
+    struct SortEntry { unsigned long long key; unsigned int list, index; };
+
+    // One recording list per thread, padded so that threads appending
+    // to neighboring lists don't share a cache line.
+    struct ItemList
+    {
+        std::vector<RenderItem> items;
+        std::vector<SortEntry> entries;
+        std::vector<IndirectCommand> ranges;
+        unsigned int rangeBase;  // Of ranges in commands, once uploaded
+        char pad[64];
+    };
+
+    // A run of sorted items [first, first+count) drawn by one
+    // multi-draw, using commands and draw data from base on.
+    struct Batch { int first, count, base; };
+
+    // A range of a model's instance buffer to be copied into the
+    // pool's instance buffer at offset.
+    struct InstanceCopy { unsigned int buffer; int offset, count; };
+
+    mat4 view;
+    std::vector<ItemList> lists;
+    std::vector<SortEntry> order, scratch;
+
+    int multiDrawState;         // -1 until MultiDrawSupported checks
+    std::vector<Batch> batches;
+    std::vector<IndirectCommand> commands;
+    std::vector<vec4> drawData;
+    std::vector<InstanceCopy> copies;
+    unsigned int drawDataBuffer, drawDataTexture, commandBuffer;
+    std::vector<int> rangeCounts;       // For glMultiDrawElements
+    std::vector<const void*> rangeOffsets;
+
+    const RenderItem& Item(const int i) const
+    { return lists[order[i].list].items[order[i].index]; }
+    unsigned long long MakeKey(const RenderItem& item) const;
+    void Sort();
+    void BuildBatches();
+    void AddRanges();
+    void UploadCommands();
+    void UploadBatches();
+    void DrawRanges(const RenderItem& it, const ItemList& list);
+};
+
+#endif
@@ -27,6 +27,8 @@
 #include "fbo.h"
 #include "models.h"
 #include "scene.h"
+#include "cputrace.h"
+#include "meshlet.h"
 
 using namespace glm;
 
@@ -76,17 +78,40 @@ void HSV2RGB(const float h, const float s, const float v, float *c)
             ret(v,p,q) }
 }
 
+// A repeatable pseudo-random number in [0,1), advancing seed.
+static float Random(unsigned int& seed)
+{
+    seed = seed*1664525u + 1013904223u;
+    return (seed>>8)/16777216.0f;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // InitializeScene is called once during setup to create all the
 // textures, model VAOs, render target FBOs, and shader programs as
 // well as a number of other parameters.
 void InitializeScene(Scene &scene)
 {
+    CPU_SCOPE("InitializeScene");
     CHECKERROR;
     scene.mode = 0;
     scene.nSpheres = 16;
     scene.drawSpheres = true;
     scene.drawGround = true;
+    scene.ringSpheres = 0;
+    scene.frustumCull = true;
+    scene.multiDraw = false;
+    scene.useLod = true;
+    scene.sunLod = scene.groundLod = scene.centralLod = 0;
+    scene.objectsTested = scene.objectsCulled = 0;
+    scene.occlusionCull = true;
+    scene.objectsOccluded = 0;
+    scene.meshletCull = true;
+    scene.meshletsTested = scene.meshletsCulled = 0;
+    scene.deferred = false;
+    scene.nPointLights = 128;
+
+    // Start the worker threads that prepare each frame
+    workers.Start();
 
     // Set the initial viewing transformation parameters
     scene.front = 0.10f;
@@ -105,24 +130,84 @@ void InitializeScene(Scene &scene)
     glEnable(GL_DEPTH_TEST);
 
     // Create the scene models
-    scene.centralPolygons =  new Teapot(12);
-    scene.spherePolygons = new Sphere(32);
-    scene.groundPolygons= new Ground(50.0, 100);
+    scene.centralPolygons =  new Teapot(12, 3);
+    scene.spherePolygons = new Sphere(32, 4);
+    scene.groundPolygons= new Ground(50.0, 100, 3);
 
     float s = 3.0/scene.centralPolygons->size;
     scene.centralTr =
         scale(Identity, s,s,s)
         *translate(-scene.centralPolygons->center);
 
-    // Create the lighting shader program from source code files.
-    scene.lightingShader.CreateProgram();
-    scene.lightingShader.CreateShader("lighting.vert", GL_VERTEX_SHADER);
-    scene.lightingShader.CreateShader("lighting.frag", GL_FRAGMENT_SHADER);
-    glBindAttribLocation(scene.lightingShader.program, 0, "vertex");
-    glBindAttribLocation(scene.lightingShader.program, 1, "vertexNormal");
-    glBindAttribLocation(scene.lightingShader.program, 2, "vertexTexture");
-    glBindAttribLocation(scene.lightingShader.program, 3, "vertexTangent");
-    scene.lightingShader.LinkProgram();
+    // Also copy them into the shared pool for multi-draw mode.  (Models
+    // created later, such as a newly chosen central model, are simply
+    // drawn on their own.)
+    Model* pooled[] = { scene.centralPolygons, scene.spherePolygons, scene.groundPolygons };
+    for (int i=0;  i<3;  i++)
+        for (int l=0;  l<pooled[i]->Levels();  l++)
+            scene.meshPool.Add(pooled[i]->Level(l));
+    scene.meshPool.Upload();
+    scene.queue.pool = &scene.meshPool;
+
+    // Occluder proxies, from the models' coarsest levels
+    scene.centralProxy.FromModel(scene.centralPolygons);
+    scene.groundProxy.FromModel(scene.groundPolygons);
+
+    // Create the lighting shader program from source code files, and
+    // the deferred geometry pass's, which shares its vertex shader.
+    // Both (and the deferred lighting pass) come in variants.
+    ShaderProgram* objectShaders[] = { &scene.lightingShader, &scene.gbufferShader };
+    const char* objectFragment[] = { "lighting.frag", "gbuffer.frag" };
+    for (int i=0;  i<2;  i++) {
+        ShaderProgram& shader = *objectShaders[i];
+        shader.CreateProgram();
+        shader.AddFeature("USE_TEXTURE");
+        shader.AddFeature("MODE", FEATURE_MODE_BITS);
+        shader.CreateShader("lighting.vert", GL_VERTEX_SHADER);
+        shader.CreateShader(objectFragment[i], GL_FRAGMENT_SHADER);
+        shader.BindAttribute(0, "vertex");
+        shader.BindAttribute(1, "vertexNormal");
+        shader.BindAttribute(2, "vertexTexture");
+        shader.BindAttribute(3, "vertexTangent");
+        shader.BindAttribute(4, "instanceModel");
+        shader.BindAttribute(8, "instanceNormal");
+        shader.BindAttribute(11, "instanceDiffuse");
+        shader.LinkProgram();
+
+        // Start on the textured variant (for the ground) now too, so
+        // it compiles alongside the rest rather than at first use.
+        shader.Variant(FEATURE_TEXTURE); }
+    scene.clusters.SetSamplers(scene.lightingShader);
+    scene.features = 0;
+
+    // The deferred lighting pass.  (The G-buffer itself is created at
+    // the first deferred frame, once the screen size is known.)
+    scene.deferredShader.CreateProgram();
+    scene.deferredShader.AddFeature("USE_TEXTURE");
+    scene.deferredShader.AddFeature("MODE", FEATURE_MODE_BITS);
+    scene.deferredShader.CreateShader("deferred.vert", GL_VERTEX_SHADER);
+    scene.deferredShader.CreateShader("deferred.frag", GL_FRAGMENT_SHADER);
+    scene.deferredShader.LinkProgram();
+    scene.clusters.SetSamplers(scene.deferredShader);
+    glGenVertexArrays(1, &scene.screenVao);
+
+    // Scatter the point lights over the ground, each with a random
+    // hue and reach.
+    unsigned int seed = 541;
+    for (int l=0;  l<MAX_POINT_LIGHTS;  l++) {
+        PointLight light;
+        light.position = vec3(90.0f*Random(seed)-45.0f, 90.0f*Random(seed)-45.0f,
+                              -2.5f + 2.5f*Random(seed));
+        light.radius = 4.0f + 6.0f*Random(seed);
+        HSV2RGB(Random(seed), 1.0f, 1.0f, &light.color[0]);
+        light.pad = 0.0f;
+        scene.pointLights.push_back(light); }
+
+    // Create the uniform buffer for the per-frame shader state.
+    glGenBuffers(1, &scene.frameDataBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, scene.frameDataBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     // Read in the needed texture maps
     try {
@@ -144,136 +229,385 @@ void InitializeScene(Scene &scene)
 }
 
 ////////////////////////////////////////////////////////////////////////
-// A small helper function to draw a model after settings its lighting
-// and modeling parmaeters.
-void DrawModel(const int program, Model* m, mat4x4& ModelTr)
-{
-    int loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(ModelTr));
+// Uniform ids used by the drawing code below.  These are interned once
+// and then valid with every ShaderProgram (see shader.h).
+static const int uGroundColor = UniformId("groundColor");
+static const int uGBuffer[] = { UniformId("gAlbedo"), UniformId("gNormal"),
+                                UniformId("gSpecular") };
+static const int uGDepth = UniformId("gDepth");
+
+// GPU profiler scopes (see gpuprofiler.h), interned the same way.
+static const int gLighting = GpuScopeId("Lighting pass");
+static const int gGeometry = GpuScopeId("Geometry pass");
+static const int gDeferred = GpuScopeId("Deferred lighting");
+static const int gSpheres = GpuScopeId("Spheres");
+static const int gGround = GpuScopeId("Ground");
+static const int gCentral = GpuScopeId("Central model");
+static const int gSun = GpuScopeId("Sun");
+
+bool Culled(Scene &scene, FrameJob& job, Model* m, const mat4x4& ModelTr);
 
-    mat4x4 NRM = inverseTranspose(ModelTr);
-    loc = glGetUniformLocation(program, "NormalMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(NRM));
-
-    loc = glGetUniformLocation(program, "phongDiffuse");
-    glUniform3fv(loc, 1, &m->diffuseColor[0]);
-
-    loc = glGetUniformLocation(program, "phongSpecular");
-    glUniform3fv(loc, 1, &m->specularColor[0]);
-
-    loc = glGetUniformLocation(program, "phongShininess");
-    glUniform1f(loc, m->shininess);
+////////////////////////////////////////////////////////////////////////
+// Projected diameter, in pixels, of an object of (half) size "size"
+// centered at the view-space point c.
+float ProjectedSize(Scene &scene, const vec3& c, const float size)
+{
+    float d = max(-c.z, scene.front);
+    return 2.0f*size*scene.lodScale/d;
+}
 
-    m->DrawVAO();
+// Choose the level of detail of model m under ModelTr from its size on
+// screen.  Argument lod holds the level used last frame, and is
+// updated.
+Model* SelectLevel(Scene &scene, Model* m, const mat4x4& ModelTr, int& lod)
+{
+    if (!scene.useLod) {
+        lod = 0;
+        return m; }
+    vec4 c = scene.lodView*(ModelTr*vec4(m->center, 1.0f));
+    float s = max(length(vec3(ModelTr[0])),
+                  max(length(vec3(ModelTr[1])), length(vec3(ModelTr[2]))));
+    lod = m->SelectLod(ProjectedSize(scene, vec3(c), s*m->size), lod);
+    return m->Level(lod);
 }
 
 ////////////////////////////////////////////////////////////////////////
-// A small helper function for DrawScene to draw all the environment
-// spheres.
-void DrawSpheres(Scene &scene, unsigned int program, mat4x4& ModelTr)
+// A small helper function to submit a model along with its lighting
+// and modeling parmaeters, at the level of detail its screen size
+// calls for, to be timed in GPU profiler scope gpuScope.  A level cut
+// into meshlets has them culled, in model coordinates, and only the
+// survivors' index ranges drawn.
+void DrawModel(Scene &scene, FrameJob& job, ShaderProgram& shader, Model* m,
+               mat4x4& ModelTr, int& lod, const int gpuScope)
 {
-    CHECKERROR;
-    float t = 1.0;
-    float s = 200.0;
-    float color[3];
-
-    int loc;
-
-    loc = glGetUniformLocation(program, "phongSpecular");
-    glUniform3fv(loc, 1, &scene.spherePolygons->specularColor[0]);
+    if (Culled(scene, job, m, ModelTr)) return;
+    m = SelectLevel(scene, m, ModelTr, lod);
+
+    RenderItem item;
+    item.shader = &shader;
+    item.features = scene.features;
+    item.model = m;
+    item.modelTr = ModelTr;
+    item.normalTr = inverseTranspose(ModelTr);
+    item.diffuseColor = m->diffuseColor;
+    item.specularColor = m->specularColor;
+    item.shininess = m->shininess;
+    item.gpuScope = gpuScope;
+
+    if (scene.meshletCull && m->meshlets) {
+        std::vector<IndirectCommand>& ranges = scene.queue.Ranges(job.thread);
+        Frustum local = scene.frustum.Transformed(ModelTr);
+        vec4 eye = inverse(ModelTr)*inverse(scene.lodView)[3];
+        item.firstRange = ranges.size();
+        int visible = m->meshlets->Cull(local, vec3(eye), ranges, job.visible);
+        item.rangeCount = ranges.size() - item.firstRange;
+        job.meshletsTested += m->meshlets->Size();
+        job.meshletsCulled += m->meshlets->Size() - visible;
+        if (!visible) return; }
+
+    scene.queue.Add(item, job.thread);
+}
 
-    loc = glGetUniformLocation(program, "phongShininess");
-    glUniform1f(loc, scene.spherePolygons->shininess);
+////////////////////////////////////////////////////////////////////////
+// Builds the per-instance records for the ring of environment spheres,
+// and a spatial index over them, in the ring's own coordinates.  This
+// only needs redoing when the number of spheres changes;  The ring's
+// rotation is applied at draw time through ModelTr, so the index never
+// needs updating as the ring turns.  The index is split into a few
+// subtrees per worker thread, each culled by a separate job.
+void BuildSphereRing(Scene &scene)
+{
+    CPU_SCOPE("BuildSphereRing");
+    scene.ring.clear();
+    scene.ringBounds.clear();
+    scene.ringIndex.Clear();
 
     for (int i=0;  i<2*scene.nSpheres;  i+=2) {
         float u = float(i)/(2*scene.nSpheres);
 
         for (int j=0;  j<=scene.nSpheres/2;  j+=2) {
             float v = float(j)/(scene.nSpheres);
-            HSV2RGB(u, 1.0f-2.0f*fabs(v-0.5f), 1.0f, color);
+            InstanceData d;
+            HSV2RGB(u, 1.0f-2.0f*fabs(v-0.5f), 1.0f, &d.diffuseColor[0]);
 
             float s = 3.0f* sin(v*3.14f);
-            mat4x4 M1 = rotate(ModelTr, 360.0f*u, 0.0f, 0.0f, 1.0f);
+            mat4x4 M1 = rotate(Identity, 360.0f*u, 0.0f, 0.0f, 1.0f);
             mat4x4 M2 = rotate(M1, 180.0f*v, 0.0f, 1.0f, 0.0f);
             mat4x4 M3 = translate(M2, 0.0f, 0.0f, 30.0f);
-            mat4x4 M4 = scale(M3, s,s,s);
-            loc = glGetUniformLocation(program, "ModelMatrix");
-            glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(M4));
-            loc = glGetUniformLocation(program, "NormalMatrix");
-            mat4x4 NRM = inverseTranspose(M4);
-            glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(NRM));
-
-            loc = glGetUniformLocation(program, "phongDiffuse");
-            glUniform3fv(loc, 1, color);
-            scene.spherePolygons->DrawVAO(); } }
-
-    loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(mat4x4(1.0f)));
-    loc = glGetUniformLocation(program, "NormalMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(mat4x4(1.0f)));
-    CHECKERROR;
+            d.modelTr = scale(M3, s,s,s);
+            d.normalTr = mat3(inverseTranspose(d.modelTr));
+            scene.ring.push_back(d);
+            scene.ringBounds.push_back(
+                vec4(vec3(d.modelTr*vec4(scene.spherePolygons->center, 1.0f)),
+                     s*scene.spherePolygons->size));
+            scene.ringIndex.Insert(scene.spherePolygons, d.modelTr); } }
+
+    scene.ringIndex.Build();
+    scene.ringIndex.Subtrees(2*workers.Threads(), scene.ringRoots);
+    scene.ringLod.assign(scene.ring.size(), 0);
+    scene.ringSpheres = scene.nSpheres;
 }
 
-void DrawGround(Scene &scene, unsigned int program, mat4x4& ModelTr)
+////////////////////////////////////////////////////////////////////////
+// Frustum and occlusion tests for a single model under transformation
+// ModelTr.  Returns true (and counts it in the job) if the model can
+// be skipped.
+bool Culled(Scene &scene, FrameJob& job, Model* m, const mat4x4& ModelTr)
 {
-    int loc = glGetUniformLocation(program, "phongDiffuse");
-    glUniform3fv(loc, 1, &scene.groundPolygons->diffuseColor[0]);
-
-    loc = glGetUniformLocation(program, "phongSpecular");
-    glUniform3fv(loc, 1, &scene.groundPolygons->specularColor[0]);
+    if (!scene.frustumCull && !scene.occlusionCull) return false;
+
+    vec3 c, e;
+    m->WorldBox(ModelTr, c, e);
+    if (scene.frustumCull) {
+        job.tested++;
+        if (!scene.frustum.TestBox(c, e)) {
+            job.culled++;
+            return true; } }
+
+    if (scene.occlusionCull && !scene.occlusion.TestBox(c, e)) {
+        job.occluded++;
+        return true; }
+    return false;
+}
 
-    loc = glGetUniformLocation(program, "phongShininess");
-    glUniform1f(loc, scene.groundPolygons->shininess);
+// The axis aligned box around box (c, e) after transformation tr.
+static void TransformBox(const mat4x4& tr, const vec3& c, const vec3& e,
+                         vec3& boxCenter, vec3& boxExtent)
+{
+    boxCenter = vec3(tr*vec4(c, 1.0f));
+    for (int i=0;  i<3;  i++)
+        boxExtent[i] = fabs(tr[0][i])*e[0] + fabs(tr[1][i])*e[1] + fabs(tr[2][i])*e[2];
+}
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, scene.groundColor);
-    loc = glGetUniformLocation(program, "groundColor");
-    glUniform1i(loc, 1);
+////////////////////////////////////////////////////////////////////////
+// A ring job:  Query one subtree of the ring's spatial index with the
+// frustum (already transformed into ring coordinates), choose each
+// sphere's level of detail, and gather the instance data of the
+// spheres found by level.  ringTr and ringView take ring coordinates
+// to world and view coordinates.
+void CullSpheres(Scene &scene, FrameJob& job, const Frustum& local,
+                 const mat4x4& ringTr, const mat4x4& ringView)
+{
+    CPU_SCOPE("CullSpheres");
+    job.hits.clear();
+    for (int l=0;  l<MAX_LODS;  l++)
+        job.instances[l].clear();
+    if (scene.frustumCull)
+        scene.ringIndex.QueryFrustum(local, job.hits, job.root);
+    else
+        scene.ringIndex.Objects(job.root, job.hits);
+
+    Model* m = scene.spherePolygons;
+    for (unsigned int i=0;  i<job.hits.size();  i++) {
+        int h = job.hits[i];
+        if (scene.occlusionCull) {
+            const SceneObject& o = scene.ringIndex.objects[h];
+            vec3 c, e;
+            TransformBox(ringTr, o.boxCenter, o.boxExtent, c, e);
+            if (!scene.occlusion.TestBox(c, e)) {
+                job.occluded++;
+                continue; } }
+
+        int lod = 0;
+        if (scene.useLod) {
+            const vec4& b = scene.ringBounds[h];
+            vec4 c = ringView*vec4(vec3(b), 1.0f);
+            lod = m->SelectLod(ProjectedSize(scene, vec3(c), b.w), scene.ringLod[h]); }
+        scene.ringLod[h] = lod;
+        job.instances[lod].push_back(scene.ring[h]); }
+}
 
-    loc = glGetUniformLocation(program, "useTexture");
-    glUniform1i(loc, 1);
+////////////////////////////////////////////////////////////////////////
+// A small helper function for DrawScene to draw all the environment
+// spheres with one instanced draw call per level of detail.  Runs on
+// the OpenGL thread after the ring jobs, uploading each job's visible
+// spheres into its own range of each level's instance buffer.
+void DrawSpheres(Scene &scene, ShaderProgram& shader, mat4x4& ModelTr)
+{
+    CPU_SCOPE("DrawSpheres");
+    int n = scene.ring.size();
+    int visible = 0;
+
+    for (int l=0;  l<scene.spherePolygons->Levels();  l++) {
+        Model* m = scene.spherePolygons->Level(l);
+        int count = 0;
+        for (unsigned int j=0;  j<scene.jobs.size();  j++)
+            if (scene.jobs[j].kind == JOB_RING)
+                count += scene.jobs[j].instances[l].size();
+        visible += count;
+        if (count == 0) continue;
+
+        m->SetInstances(NULL, count);
+        int first = 0;
+        for (unsigned int j=0;  j<scene.jobs.size();  j++) {
+            const FrameJob& job = scene.jobs[j];
+            if (job.kind != JOB_RING || job.instances[l].empty()) continue;
+            m->UpdateInstances(&job.instances[l][0], first, job.instances[l].size());
+            first += job.instances[l].size(); }
+
+        RenderItem item;
+        item.shader = &shader;
+        item.features = scene.features;
+        item.model = m;
+        item.instanced = true;
+        item.modelTr = ModelTr;
+        item.normalTr = inverseTranspose(ModelTr);
+        item.specularColor = m->specularColor;
+        item.shininess = m->shininess;
+        item.gpuScope = gSpheres;
+        scene.queue.Add(item); }
+
+    // Spheres neither drawn nor occluded were outside the frustum.
+    int occluded = 0;
+    for (unsigned int j=0;  j<scene.jobs.size();  j++)
+        if (scene.jobs[j].kind == JOB_RING)
+            occluded += scene.jobs[j].occluded;
+    if (scene.frustumCull) {
+        scene.objectsTested += n;
+        scene.objectsCulled += n-visible-occluded; }
+}
 
-    loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(ModelTr));
-    mat4x4 NRM = inverseTranspose(ModelTr);
-    loc = glGetUniformLocation(program, "NormalMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(NRM));
+void DrawGround(Scene &scene, FrameJob& job, ShaderProgram& shader, mat4x4& ModelTr)
+{
+    if (Culled(scene, job, scene.groundPolygons, ModelTr)) return;
+    Model* m = SelectLevel(scene, scene.groundPolygons, ModelTr, scene.groundLod);
+
+    RenderItem item;
+    item.shader = &shader;
+    item.features = scene.features;
+    item.model = m;
+    item.modelTr = ModelTr;
+    item.normalTr = inverseTranspose(ModelTr);
+    item.diffuseColor = m->diffuseColor;
+    item.specularColor = m->specularColor;
+    item.shininess = m->shininess;
+    item.features |= FEATURE_TEXTURE;
+    item.textureCount = 1;
+    item.textures[0].unit = 1;
+    item.textures[0].sampler = uGroundColor;
+    item.textures[0].texture = scene.groundColor;
+    item.gpuScope = gGround;
+    scene.queue.Add(item, job.thread);
+}
 
-    scene.groundPolygons->DrawVAO();
-    CHECKERROR;
+void DrawSun(Scene &scene, FrameJob& job, ShaderProgram& shader, mat4x4& ModelTr)
+{
+    DrawModel(scene, job, shader, scene.spherePolygons, ModelTr, scene.sunLod, gSun);
+}
 
-    loc = glGetUniformLocation(program, "useTexture");
-    glUniform1i(loc, 0);
+////////////////////////////////////////////////////////////////////////
+// The per-frame values shared by all preparation jobs.
+struct FrameContext
+{
+    Scene* scene;
+    ShaderProgram* shader;
+    mat4 SunModelTr;
+    Frustum ringFrustum;        // The frustum in ring coordinates
+    mat4 ringTr;                // Ring to world coordinates
+    mat4 ringView;              // Ring to view coordinates
+};
+
+// Run by the worker pool for each of scene.jobs.
+static void PrepareJob(int index, int thread, void* data)
+{
+    CPU_SCOPE("PrepareJob");
+    FrameContext& f = *(FrameContext*)data;
+    Scene& scene = *f.scene;
+    FrameJob& job = scene.jobs[index];
+    job.thread = thread;
+    job.tested = job.culled = job.occluded = 0;
+    job.meshletsTested = job.meshletsCulled = 0;
+
+    switch (job.kind) {
+    case JOB_SUN:
+        DrawSun(scene, job, *f.shader, f.SunModelTr);
+        break;
+    case JOB_GROUND:
+        DrawGround(scene, job, *f.shader, Identity);
+        break;
+    case JOB_CENTRAL:
+        DrawModel(scene, job, *f.shader, scene.centralPolygons, scene.centralTr,
+                  scene.centralLod, gCentral);
+        break;
+    case JOB_RING:
+        CullSpheres(scene, job, f.ringFrustum, f.ringTr, f.ringView);
+        break; }
+}
 
+static void AddJob(Scene &scene, int& count, const int kind, const int root=-1)
+{
+    if ((int)scene.jobs.size() <= count)
+        scene.jobs.resize(count+1);
+    scene.jobs[count].kind = kind;
+    scene.jobs[count].root = root;
+    count++;
 }
 
-void DrawSun(Scene &scene, unsigned int program, mat4x4& ModelTr)
+////////////////////////////////////////////////////////////////////////
+// The G-buffer's attachments;  See gbuffer.glsl.
+static const unsigned int gbufferFormats[] = { GL_RGBA8, GL_RG16, GL_RGBA8 };
+static const int GBUFFER_TARGETS = 3;
+
+// Make the G-buffer match the screen, creating it on first use.
+void PrepareGBuffer(Scene &scene)
 {
-    int loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(ModelTr));
+    if (!scene.gbuffer.fbo)
+        scene.gbuffer.Create(scene.width, scene.height, GBUFFER_TARGETS,
+                             gbufferFormats, GL_DEPTH_COMPONENT24);
+    else
+        scene.gbuffer.Resize(scene.width, scene.height);
+}
 
-    scene.spherePolygons->DrawVAO();
-    CHECKERROR;
+////////////////////////////////////////////////////////////////////////
+// The deferred lighting pass:  Light every covered pixel of the
+// G-buffer once, with a single full-screen triangle, into framebuffer
+// output.
+void DeferredLighting(Scene &scene, const unsigned int output)
+{
+    GpuScope scope(gDeferred);
+    glBindFramebuffer(GL_FRAMEBUFFER, output);
+    glClearColor(0.5,0.5, 0.5, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT| GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+
+    ShaderProgram& shader = *scene.deferredShader.Usable(scene.features);
+    shader.Use();
+    for (int i=0;  i<GBUFFER_TARGETS;  i++) {
+        glActiveTexture(GL_TEXTURE0+i);
+        glBindTexture(GL_TEXTURE_2D, scene.gbuffer.Texture(i));
+        shader.SetUniform(uGBuffer[i], i); }
+    glActiveTexture(GL_TEXTURE0+GBUFFER_TARGETS);
+    glBindTexture(GL_TEXTURE_2D, scene.gbuffer.DepthTexture());
+    shader.SetUniform(uGDepth, GBUFFER_TARGETS);
+
+    glBindVertexArray(scene.screenVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    shader.Unuse();
+
+    for (int i=GBUFFER_TARGETS;  i>=0;  i--) {
+        glActiveTexture(GL_TEXTURE0+i);
+        glBindTexture(GL_TEXTURE_2D, 0); }
+    glEnable(GL_DEPTH_TEST);
 }
 
 ////////////////////////////////////////////////////////////////////////
-// Called regularly to update the rotation of the surrounding sphere
+// Called by the frame scheduler (scheduler.h) for each fixed time step
+// of dt seconds, to update the rotation of the surrounding sphere
 // environment.  Set to rotate once every two minutes.
 float atime = 0.0;
-void animate(int value)
+void StepAnimation(const double dt)
 {
-    atime = 360.0f*glutGet(GLUT_ELAPSED_TIME)/120000.0f;
-    glutPostRedisplay();
+    atime = fmod(atime + 360.0*dt/120.0, 360.0);
 }
 
 ////////////////////////////////////////////////////////////////////////
 // Procedure DrawScene is called whenever the scene needs to be drawn.
 void DrawScene(Scene &scene)
 {
+    CPU_SCOPE("DrawScene");
     CHECKERROR;
 
-    int loc, program;
-
     // Calculate the light's position.
     float lPos[4] = {
        scene.lightDist*cos(scene.lightSpin*rad)*sin(scene.lightTilt*rad),
@@ -294,65 +628,111 @@ void DrawScene(Scene &scene)
     mat4x4 WorldInv = affineInverse(WorldView);
     mat4x4 WorldProj = frustum(-sx, sx, -sy, sy, scene.front, 10000.0f);
 
-    glutTimerFunc(100, animate, 1);
-
     ///////////////////////////////////////////////////////////////////
     // Lighting pass: Draw the scene with lighting being calculated in
-    // the lighting shader.
+    // the lighting shader.  Or, when deferred, the geometry pass:  Draw
+    // the scene into the G-buffer, to be lit afterwards.
     ///////////////////////////////////////////////////////////////////
 
-    program = scene.lightingShader.program;
+    ShaderProgram& shader = scene.deferred ? scene.gbufferShader : scene.lightingShader;
+    gpuProfiler.Begin(scene.deferred ? gGeometry : gLighting);
+    GLint output = 0;           // Where the lit image goes
+    if (scene.deferred) {
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        PrepareGBuffer(scene);
+        scene.gbuffer.Bind();
+        glClearColor(0.0, 0.0, 0.0, 0.0); }
+    else
+        glClearColor(0.5,0.5, 0.5, 1.0);
+
     // Set the viewport, and clear the screen
     glViewport(0,0,scene.width, scene.height);
-    glClearColor(0.5,0.5, 0.5, 1.0);
     glClear(GL_COLOR_BUFFER_BIT| GL_DEPTH_BUFFER_BIT);
 
-    // Use lighting pass shader
-    scene.lightingShader.Use();
-
-    // Setup the perspective and modelview matrices for normal viewing.
-    loc = glGetUniformLocation(program, "ProjectionMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(WorldProj));
-    loc = glGetUniformLocation(program, "ViewMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(WorldView));
-    loc = glGetUniformLocation(program, "ViewInverse");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(WorldInv));
-    CHECKERROR;
-
-    // Setup the initial model matrix (in gl_ModelViewMatrix)
-    loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(Identity));
-    loc = glGetUniformLocation(program, "NormalMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, value_ptr(Identity));
-    CHECKERROR;
-
-    // Make each texture from earlier passes active in a texture unit, and
-    // inform lightingShader.
-    loc = glGetUniformLocation(program, "lightAmbient");
-    glUniform3fv(loc, 1, ambientColor);
-    loc = glGetUniformLocation(program, "lightPos");
-    glUniform3fv(loc, 1, lPos);
-    loc = glGetUniformLocation(program, "lightValue");
-    glUniform3fv(loc, 1, lightColor);
-
-    loc = glGetUniformLocation(program, "mode");
-    glUniform1i(loc, scene.mode);
-
-    loc = glGetUniformLocation(program, "WIDTH");
-    glUniform1i(loc, scene.width);
-
-    loc = glGetUniformLocation(program, "HEIGHT");
-    glUniform1i(loc, scene.height);
-
-    // Draw the scene objects.
-    DrawSun(scene, program, SunModelTr);
-    if (scene.drawSpheres) DrawSpheres(scene, program, SphereModelTr);
-    if (scene.drawGround) DrawGround(scene, program, Identity);
-    DrawModel(program, scene.centralPolygons, scene.centralTr);
+    // Place the point lights, turning with the sphere ring, and find
+    // the clusters each one reaches.
+    int nLights = clamp(scene.nPointLights, 0, (int)scene.pointLights.size());
+    scene.clusters.lights.resize(nLights);
+    for (int l=0;  l<nLights;  l++) {
+        scene.clusters.lights[l] = scene.pointLights[l];
+        scene.clusters.lights[l].position =
+            vec3(SphereModelTr*vec4(scene.pointLights[l].position, 1.0f)); }
+    scene.clusters.Build(WorldView, WorldProj, scene.front);
+    scene.clusters.Upload();
+
+    // Send the camera and light state to all shaders in one upload.
+    FrameData frame;
+    frame.ProjectionMatrix = WorldProj;
+    frame.ViewMatrix = WorldView;
+    frame.ViewInverse = WorldInv;
+    frame.ViewProjection = WorldProj*WorldView;
+    frame.lightPos = make_vec3(lPos);
+    frame.lightValue = make_vec3(lightColor);
+    frame.lightAmbient = make_vec3(ambientColor);
+    frame.WIDTH = scene.width;
+    frame.HEIGHT = scene.height;
+    frame.clusterCount = scene.clusters.Counts();
+    frame.clusterDepth = scene.clusters.DepthParams();
+    glBindBuffer(GL_UNIFORM_BUFFER, scene.frameDataBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, scene.frameDataBuffer);
     CHECKERROR;
 
-    // Done with shader program
-    scene.lightingShader.Unuse();
+    // Draw the occluders into the CPU depth buffer.
+    if (scene.occlusionCull) {
+        CPU_SCOPE("Occluders");
+        scene.occlusion.Begin(WorldProj*WorldView, scene.width, scene.height);
+        scene.occlusion.AddOccluder(scene.centralProxy, scene.centralTr);
+        if (scene.drawGround)
+            scene.occlusion.AddOccluder(scene.groundProxy, Identity);
+        scene.occlusion.Rasterize(); }
+
+    // Prepare the frame on the worker pool:  Cull the scene objects and
+    // record their RenderItems (and the visible ring spheres).
+    scene.frustum.FromMatrix(WorldProj*WorldView);
+    scene.lodView = WorldView;
+    scene.lodScale = WorldProj[1][1]*scene.height/2.0f;
+    scene.queue.multiDraw = scene.multiDraw;
+    scene.features = clamp(scene.mode, 0, (1<<FEATURE_MODE_BITS)-1) << FEATURE_MODE_SHIFT;
+    scene.queue.Begin(WorldView, workers.Threads());
+    if (scene.drawSpheres && scene.ringSpheres != scene.nSpheres)
+        BuildSphereRing(scene);
+
+    FrameContext context;
+    context.scene = &scene;
+    context.shader = &shader;
+    context.SunModelTr = SunModelTr;
+    int count = 0;
+    AddJob(scene, count, JOB_SUN);
+    if (scene.drawGround) AddJob(scene, count, JOB_GROUND);
+    AddJob(scene, count, JOB_CENTRAL);
+    if (scene.drawSpheres) {
+        context.ringFrustum = scene.frustum.Transformed(SphereModelTr);
+        context.ringTr = SphereModelTr;
+        context.ringView = WorldView*SphereModelTr;
+        for (unsigned int r=0;  r<scene.ringRoots.size();  r++)
+            AddJob(scene, count, JOB_RING, scene.ringRoots[r]); }
+    scene.jobs.resize(count);
+    workers.Run(count, PrepareJob, &context);
+
+    scene.objectsTested = scene.objectsCulled = scene.objectsOccluded = 0;
+    scene.meshletsTested = scene.meshletsCulled = 0;
+    for (int j=0;  j<count;  j++) {
+        scene.objectsTested += scene.jobs[j].tested;
+        scene.objectsCulled += scene.jobs[j].culled;
+        scene.objectsOccluded += scene.jobs[j].occluded;
+        scene.meshletsTested += scene.jobs[j].meshletsTested;
+        scene.meshletsCulled += scene.jobs[j].meshletsCulled; }
+
+    // Back on this (the OpenGL) thread:  Upload the ring's instances,
+    // then sort and draw everything.
+    if (scene.drawSpheres) DrawSpheres(scene, shader, SphereModelTr);
+    scene.queue.Flush();
+    gpuProfiler.End();
+
+    if (scene.deferred)
+        DeferredLighting(scene, output);
     CHECKERROR;
 
 }
@@ -17,13 +17,68 @@
 using namespace glm;
 
 #include "models.h"
+#include "fbo.h"
+#include "renderqueue.h"
+#include "frustum.h"
+#include "spatial.h"
+#include "workers.h"
+#include "occlusion.h"
+#include "gpuprofiler.h"
+#include "lights.h"
+
+////////////////////////////////////////////////////////////////////////
+// CPU copy of the per-frame uniform block declared in framedata.glsl.
+// It follows the std140 layout rules (vec3s padded to 16 bytes) and
+// must match that block member for member.
+struct FrameData
+{
+    mat4 ProjectionMatrix;
+    mat4 ViewMatrix, ViewInverse;
+    mat4 ViewProjection;
+
+    vec3 lightPos;      float pad0;
+    vec3 lightValue;    float pad1;
+    vec3 lightAmbient;  float pad2;
+
+    int WIDTH, HEIGHT;
+    int pad3, pad4;
+
+    ivec4 clusterCount;
+    vec4 clusterDepth;
+};
+
+////////////////////////////////////////////////////////////////////////
+// One piece of the per-frame preparation work (culling, matrices,
+// recording RenderItems) that DrawScene hands to the worker pool, and
+// its results.  Jobs make no OpenGL calls.
+enum FrameJobKind { JOB_SUN, JOB_GROUND, JOB_CENTRAL, JOB_RING };
+
+struct FrameJob
+{
+    int kind;
+    int root;                   // JOB_RING:  Subtree of the ring's index
+    int thread;                 // Pool thread running the job
+    int tested, culled;         // Frustum test counts
+    int occluded;               // Objects hidden by the occluders
+    int meshletsTested, meshletsCulled;
+    std::vector<unsigned char> visible; // Scratch for meshlet culling
+    std::vector<int> hits;      // JOB_RING:  Visible sphere handles ...
+    std::vector<InstanceData> instances[MAX_LODS];  // ... by level of detail
+};
+
+////////////////////////////////////////////////////////////////////////
+// The feature mask of the scene's shader variants (see shader.h),
+// declared in this order by InitializeScene for every program.
+enum { FEATURE_TEXTURE = 1<<0,          // USE_TEXTURE
+       FEATURE_MODE_SHIFT = 1,          // MODE, from Scene::mode
+       FEATURE_MODE_BITS = 4 };
 
 class Scene
 {
 public:
     // Some user controllable parameters
-    int mode;  // Communicated to the shaders as "mode".  Keys '0'-'9'
-    int nSpheres;
+    int mode;  // Chooses the shaders' MODE variant.  Keys '0'-'9'
+    int nSpheres;  // Ring of nSpheres*(nSpheres/4+1) instances
     bool drawSpheres;
     bool drawGround;
 
@@ -48,8 +103,74 @@ public:
     // Viewport
     int width, height;
 
-    // Shader programs
+    // Shader programs, and the features of this frame's variants
     ShaderProgram lightingShader;
+    unsigned int features;
+
+    // Deferred shading, instead of the forward lighting pass:  A
+    // geometry pass into the G-buffer (see gbuffer.glsl), then one
+    // full-screen lighting pass.
+    bool deferred;
+    ShaderProgram gbufferShader, deferredShader;
+    FBO gbuffer;
+    unsigned int screenVao;     // Empty;  The pass needs no vertices
+
+    // Point lights scattered over the ground (in the sphere ring's
+    // coordinates, turning with it), the first nPointLights of which
+    // are lit through clustered light culling.
+    int nPointLights;
+    std::vector<PointLight> pointLights;
+    LightClusters clusters;
+
+    // Uniform buffer holding FrameData, bound at FRAME_DATA_BINDING
+    unsigned int frameDataBuffer;
+
+    // Draw requests for the current frame, sorted before submission
+    RenderQueue queue;
+
+    // The initial models' geometry in one shared pool, so that the
+    // queue's multi-draw mode can batch them
+    MeshPool meshPool;
+    bool multiDraw;
+
+    // View-frustum culling, with the frustum rebuilt every frame
+    bool frustumCull;
+    Frustum frustum;
+    int objectsTested, objectsCulled;  // Counts for the last frame
+
+    // Software occlusion culling:  The central model and the ground
+    // are drawn (as proxies) into a CPU depth buffer each frame, and
+    // other objects tested against it.
+    bool occlusionCull;
+    OcclusionBuffer occlusion;
+    OccluderProxy centralProxy, groundProxy;
+    int objectsOccluded;               // Count for the last frame
+
+    // Meshlet culling of large models (meshlet.h)
+    bool meshletCull;
+    int meshletsTested, meshletsCulled; // Counts for the last frame
+
+    // Level of detail selection:  The view transformation and the
+    // pixels per unit of size at unit distance, set every frame, and
+    // the level each object was last drawn at.
+    bool useLod;
+    mat4 lodView;
+    float lodScale;
+    int sunLod, groundLod, centralLod;
+
+    // The sphere ring's instances, and a spatial index over them (both
+    // in ring coordinates), split into subtrees culled in parallel.
+    // Each sphere's center and size (for choosing its level of detail)
+    // and last level are kept alongside.
+    int ringSpheres;  // nSpheres value the ring was built for
+    std::vector<InstanceData> ring;
+    std::vector<vec4> ringBounds;
+    std::vector<unsigned char> ringLod;
+    SpatialIndex ringIndex;
+    std::vector<int> ringRoots;
+
+    // This frame's preparation jobs, run on the worker pool
+    std::vector<FrameJob> jobs;
 
     // The polygon models
     Model* centralPolygons;
@@ -63,3 +184,8 @@ public:
 void InitializeScene(Scene &scene);
 void BuildScene(Scene &scene);
 void DrawScene(Scene &scene);
+
+// The sphere ring's rotation in degrees, and the animation step that
+// advances it by dt seconds.
+extern float atime;
+void StepAnimation(const double dt);
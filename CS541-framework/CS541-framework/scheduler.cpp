@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////
+// Paces the interactive loop;  See scheduler.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <thread>
+
+#ifdef _WIN32
+    #include <glload/wgl_all.h>
+    #include <glload/wgl_load.h>
+#else
+    // Keep the system's glx.h from declaring the extensions itself.
+    #define GLX_GLXEXT_LEGACY
+    #include <glload/glx_all.h>
+    #include <glload/glx_load.h>
+#endif
+#include <GL/freeglut.h>
+
+#include "scheduler.h"
+
+FrameScheduler scheduler;
+
+// The longest single sleep, to keep input responsive at low rates.
+static const std::chrono::milliseconds MAX_SLEEP(50);
+
+FrameScheduler::FrameScheduler()
+    :targetRate(60.0f), swapInterval(1), animating(true), time(0.0),
+     accumulator(0.0)
+{
+}
+
+// Apply the swap interval, and start requesting frames.  Needs the
+// window's context to be current.
+void FrameScheduler::Start()
+{
+    last = next = Clock::now();
+    SetSwapInterval(swapInterval);
+    SetAnimating(animating);
+}
+
+// Advance the animation to the present in fixed steps, calling step
+// for each.  Any remainder short of a step is carried to the next
+// call.  While not animating, time stands still.
+void FrameScheduler::Update(StepFunction step)
+{
+    Clock::time_point now = Clock::now();
+    double elapsed = std::chrono::duration<double>(now-last).count();
+    last = now;
+    if (!animating) return;
+
+    accumulator += elapsed < MAX_CATCH_UP ? elapsed : MAX_CATCH_UP;
+    while (accumulator >= FIXED_STEP) {
+        step(FIXED_STEP);
+        time += FIXED_STEP;
+        accumulator -= FIXED_STEP; }
+}
+
+void FrameScheduler::SetAnimating(const bool on)
+{
+    animating = on;
+    accumulator = 0.0;
+    last = Clock::now();        // Resume from now, not from the pause
+    glutIdleFunc(on ? Idle : NULL);
+    glutPostRedisplay();
+}
+
+// Set the number of vertical retraces each buffer swap waits for,
+// where the platform's swap control extension allows.
+void FrameScheduler::SetSwapInterval(const int n)
+{
+    swapInterval = n;
+#ifdef _WIN32
+    static bool loaded = false;
+    if (!loaded)
+        loaded = wgl_LoadFunctions(wglGetCurrentDC()) != wgl_LOAD_FAILED;
+    if (loaded && wglext_EXT_swap_control)
+        wglSwapIntervalEXT(n);
+#else
+    Display* display = glXGetCurrentDisplay();
+    if (!display) return;
+    static bool loaded = false;
+    if (!loaded)
+        loaded = glx_LoadFunctions(display, DefaultScreen(display)) != glx_LOAD_FAILED;
+    if (loaded && glXext_EXT_swap_control)
+        glXSwapIntervalEXT(display, glXGetCurrentDrawable(), n);
+    else if (loaded && glXext_SGI_swap_control && n > 0)
+        glXSwapIntervalSGI(n);
+#endif
+}
+
+// GLUT calls this whenever it has no events to handle.  Request a
+// redraw when the next frame is due, and sleep until then otherwise.
+void FrameScheduler::Idle()
+{
+    FrameScheduler& s = scheduler;
+    if (s.targetRate <= 0.0f) {
+        glutPostRedisplay();
+        return; }
+
+    Clock::time_point now = Clock::now();
+    if (now < s.next) {
+        Clock::duration wait = s.next-now;
+        std::this_thread::sleep_for(wait < MAX_SLEEP ? wait : Clock::duration(MAX_SLEEP));
+        return; }
+
+    // Keep to a regular beat, unless too far behind to catch up.
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0/s.targetRate));
+    s.next += period;
+    if (s.next < now)
+        s.next = now + period;
+    glutPostRedisplay();
+}
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////
+// Paces the interactive loop.  Animation is decoupled from drawing:
+// Each redraw first calls "Update", which advances the animation in
+// fixed steps of FIXED_STEP seconds (as many as the time since the
+// last redraw calls for), measured with one high resolution clock.
+// Redraws themselves are requested from GLUT's idle callback, at
+// targetRate frames per second while animating, with the time in
+// between spent asleep.  Once the animation stops, so does the idle
+// callback, and the program sleeps in GLUT's event loop until input
+// (whose callbacks request their own redraws) arrives.
+//
+// A targetRate of 0 means no limit:  A redraw is requested as soon as
+// the last one is done, and swapInterval (the number of vertical
+// retraces each buffer swap waits for) alone sets the pace.
+//
+// Usage:
+//    scheduler.Start();                  // Once the window exists
+//    ... in the display callback:
+//    scheduler.Update(StepAnimation);    // Before drawing
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SCHEDULER
+#define _SCHEDULER
+
+#include <chrono>
+
+const double FIXED_STEP = 1.0/240.0;   // Seconds per animation step
+const double MAX_CATCH_UP = 0.25;      // Longest gap the animation spans
+
+typedef void (*StepFunction)(const double dt);
+
+class FrameScheduler
+{
+public:
+    FrameScheduler();
+
+    float targetRate;           // Frames per second;  0 for no limit
+    int swapInterval;           // Use SetSwapInterval to change
+    bool animating;             // Use SetAnimating to change
+    double time;                // Animated seconds, in whole steps
+
+    void Start();
+    void Update(StepFunction step);
+    void SetAnimating(const bool on);
+    void SetSwapInterval(const int n);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point last;     // Of the last Update
+    Clock::time_point next;     // When the next frame is due
+    double accumulator;         // Seconds not yet stepped
+
+    static void Idle();
+};
+
+extern FrameScheduler scheduler;
+
+#endif
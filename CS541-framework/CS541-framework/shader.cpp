@@ -12,15 +12,31 @@
 
 #include "shader.h"
 #include <fstream>
-#include <glload/gl_3_3.h>
+#include <map>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <glload/gl_4_3.h>
 #include <glload/gl_load.hpp>
 #include <GL/freeglut.h>
 
-// Reads a specified file into a string and returns the string.
+#ifdef _WIN32
+    #include <direct.h>
+    #define MakeDirectory(dir) _mkdir(dir)
+#else
+    #include <sys/stat.h>
+    #define MakeDirectory(dir) mkdir(dir, 0755)
+#endif
+
+// Reads a specified file into a string and returns the string, or
+// NULL if the file can't be opened.
 char* ReadFile(const char* name)
 {
     std::ifstream f;
     f.open(name, std::ios_base::binary); // Open
+    if (!f.is_open()) return NULL;
     f.seekg(0, std::ios_base::end);      // Position at end
     int length = f.tellg();              //   to get the length
 
@@ -33,15 +49,101 @@ char* ReadFile(const char* name)
     return content;
 }
 
+// Reads a shader source file, replacing each line of the form
+//    #include "name"
+// with the (similarly expanded) contents of the named file.  GLSL 3.30
+// has no #include, so declarations shared between shaders, such as
+// the FrameData block, are spliced in here, between #line directives
+// that keep the line numbers of compile logs right:  Source string
+// number k is files[k], 0 being the file named.  A file including
+// itself, directly or not, is an error.
+struct IncludeChain { const char* name;  const IncludeChain* includer; };
+
+std::string ReadShaderSource(const char* name, std::vector<std::string>& files,
+                             const IncludeChain* includer=NULL)
+{
+    for (const IncludeChain* c=includer;  c;  c=c->includer)
+        if (!strcmp(c->name, name)) {
+            printf("Shader Error: File %s (included from %s) includes itself\n",
+                   name, includer->name);
+            exit(-1); }
+
+    char* content = ReadFile(name);
+    if (content == NULL) {
+        if (includer)
+            printf("Shader Error: File %s (included from %s) not found\n", name, includer->name);
+        else
+            printf("Shader Error: File %s not found\n", name);
+        exit(-1); }
+    std::string src(content);
+    delete[] content;
+    const IncludeChain chain = { name, includer };
+
+    const int string = (int)files.size();
+    files.push_back(name);
+    std::string out;
+    char mark[64];
+    int line = 1;
+    std::string::size_type bol = 0;
+    while (bol < src.size()) {
+        std::string::size_type eol = src.find('\n', bol);
+        std::string::size_type next = (eol == std::string::npos) ? src.size() : eol+1;
+        std::string::size_type pos = src.find_first_not_of(" \t", bol);
+        std::string::size_type q0 = src.find('"', bol);
+        std::string::size_type q1 = (q0 == std::string::npos) ? q0 : src.find('"', q0+1);
+        if (pos < next && src.compare(pos, 8, "#include") == 0
+            && q1 != std::string::npos && q1 < eol) {
+            std::string file = src.substr(q0+1, q1-q0-1);
+            sprintf(mark, "#line 1 %d\n", (int)files.size());
+            out += mark;
+            out += ReadShaderSource(file.c_str(), files, &chain);
+            if (!out.empty() && out[out.size()-1] != '\n')
+                out += '\n';
+            sprintf(mark, "#line %d %d\n", line+1, string);
+            out += mark; }
+        else
+            out.append(src, bol, next-bol);
+        bol = next;
+        line++; }
+
+    return out;
+}
+
+// The global table of uniform names.  Ids are dense small integers so
+// each program can map an id to its own uniform with a vector lookup.
+int UniformId(const char* name)
+{
+    static std::map<std::string, int> ids;
+    std::map<std::string, int>::iterator it = ids.find(name);
+    if (it != ids.end())
+        return it->second;
+    int id = (int)ids.size();
+    ids[name] = id;
+    return id;
+}
+
+ShaderProgram::ShaderProgram()
+    :program(0), mask(0), pending(false)
+{
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    std::map<unsigned int, ShaderProgram*>::iterator it;
+    for (it=variants.begin();  it!=variants.end();  it++)
+        delete it->second;
+}
+
 // Asks OpenGL to create an empty shader program.
 void ShaderProgram::CreateProgram()
 { 
     program = glCreateProgram();
 }
 
-// Use a shader program
+// Use a shader program, first waiting for its link if need be.
 void ShaderProgram::Use()
 {
+    Finish();
     glUseProgram(program);
 }
 
@@ -51,49 +153,447 @@ void ShaderProgram::Unuse()
     glUseProgram(0);
 }
 
-// Read, send to OpenGL, and compile a single file into a shader program.
+// Read a single file of shader code, to be compiled into the program
+// by LinkProgram (unless a cached binary makes that unnecessary).
 void ShaderProgram::CreateShader(const char* fileName, int type)
 {
-    // Read the source from the named file
-    char* src = ReadFile(fileName);
-    const char* psrc[1] = {src};
+    // Read the source from the named file, and add this variant's
+    // features after the #version line, renumbering the lines after.
+    std::vector<std::string> files;
+    std::string src = ReadShaderSource(fileName, files);
+    if (!features.empty()) {
+        std::string::size_type pos = src.find("#version");
+        pos = pos == std::string::npos ? 0 : src.find('\n', pos);
+        pos = pos == std::string::npos ? src.size() : pos+1;
+        char mark[32];
+        sprintf(mark, "#line %d 0\n", 1 + (int)std::count(src.begin(), src.begin()+pos, '\n'));
+        src.insert(pos, Defines() + mark); }
+
+    Source source = { fileName, type, src, files };
+    sources.push_back(source);
+}
 
-    // Create a shader and attach, hand it the source, and compile it.
-    int shader = glCreateShader(type);
+// Send one recorded source to OpenGL, start compiling it, and attach
+// it.  Deleting it only flags it;  It lives as long as the program.
+// Its status is only looked at by Finish.
+void ShaderProgram::CompileShader(const Source& source)
+{
+    const char* psrc[1] = {source.text.c_str()};
+    int shader = glCreateShader(source.type);
     glAttachShader(program, shader);
     glShaderSource(shader, 1, psrc, NULL);
     glCompileShader(shader);
-    delete src;
+    glDeleteShader(shader);
+    shaders.push_back(shader);
+}
 
-    // Get the compilation status
-    int status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-    
-    // If compilation status is not OK, get and print the log message.
-    if (status != 1) {
-        int length;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-        char* buffer = new char[length];
-        glGetShaderInfoLog(shader, length, NULL, buffer);
-        printf("Compile log for %s:\n%s\n", fileName, buffer);
-        delete buffer;
-    }
+// Bind a vertex attribute's name to an index, before linking.
+void ShaderProgram::BindAttribute(const int index, const char* name)
+{
+    Attribute a = { index, name };
+    attributes.push_back(a);
+    glBindAttribLocation(program, index, name);
 }
 
+#ifndef GL_COMPLETION_STATUS_KHR
+    #define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// KHR_parallel_shader_compile (or its ARB twin, with the same enum)
+// lets the completion of a compile or link be asked about without
+// waiting for it.  Checked once.
+static bool ParallelCompileSupported()
+{
+    static int supported = -1;
+    if (supported < 0) {
+        supported = 0;
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (int i=0;  i<count;  i++) {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (!strcmp(name, "GL_KHR_parallel_shader_compile")
+                || !strcmp(name, "GL_ARB_parallel_shader_compile"))
+                supported = 1; } }
+    return supported == 1;
+}
+
+// Start linking the program.  A cached binary is loaded right away;
+// Otherwise the shaders are compiled and linked, which a driver with
+// KHR_parallel_shader_compile does in the background.  Nothing is
+// asked of the result here, since that would wait for it:  Ready()
+// polls for it, and Finish() (or Use()) waits for it.
 void ShaderProgram::LinkProgram()
 {
-    // Link program and check the status
+    // A binary cached from the very same sources, by the very same
+    // driver, replaces compiling and linking altogether.
+    pending = true;
+    binaryFile = CacheFile();
+    if (!binaryFile.empty() && LoadBinary(binaryFile)) {
+        cached++;
+        return; }
+
+    for (unsigned int i=0;  i<sources.size();  i++)
+        CompileShader(sources[i]);
+    if (!binaryFile.empty())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
+    compiled++;
+}
+
+// Has the link finished?  Completes the program if so.  Without
+// KHR_parallel_shader_compile there is no asking without waiting, so
+// this waits.
+bool ShaderProgram::Ready()
+{
+    if (!pending) return true;
+    if (!shaders.empty() && ParallelCompileSupported()) {
+        int done;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) return false; }
+    Finish();
+    return true;
+}
+
+// Wait for the link, report any errors, save the binary if new, and
+// set up the linked program.
+void ShaderProgram::Finish()
+{
+    if (!pending) return;
+    pending = false;
+
+    if (!shaders.empty()) {
+        // If compilation status is not OK, get and print the log message.
+        for (unsigned int i=0;  i<shaders.size();  i++) {
+            int status;
+            glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &status);
+            if (status != 1) {
+                int length;
+                glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &length);
+                char* buffer = new char[length];
+                glGetShaderInfoLog(shaders[i], length, NULL, buffer);
+                printf("Compile log for %s:\n", sources[i].fileName.c_str());
+                for (unsigned int k=1;  k<sources[i].files.size();  k++)
+                    printf("  (source %d is %s)\n", k, sources[i].files[k].c_str());
+                printf("%s\n", buffer);
+                delete buffer;
+            }
+        }
+
+        // Check the link status;  If link failed, get and print log
+        int status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != 1) {
+            int length;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            char* buffer = new char[length];
+            glGetProgramInfoLog(program, length, NULL, buffer);
+            printf("Link log:\n%s\n", buffer);
+            delete buffer;
+        }
+        else if (!binaryFile.empty())
+            SaveBinary(binaryFile);
+        shaders.clear(); }
+
+    // Attach the shared per-frame block, if used, to its binding point.
+    unsigned int block = glGetUniformBlockIndex(program, "FrameData");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, block, FRAME_DATA_BINDING);
+
+    ReflectUniforms();
+    ApplySamplerUnits();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Program binary cache
+
+std::string ShaderProgram::cacheDirectory = "shadercache";
+int ShaderProgram::cached = 0;
+int ShaderProgram::compiled = 0;
+
+static const unsigned int BINARY_MAGIC = 0x42505347; // "GSPB"
+
+// Program binaries need OpenGL 4.1 (or ARB_get_program_binary), and a
+// driver that offers at least one binary format.  Checked once.
+static bool BinariesSupported()
+{
+    static int supported = -1;
+    if (supported < 0) {
+        int formats = 0;
+        if (glload::IsVersionGEQ(4, 1) || glext_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0 ? 1 : 0; }
+    return supported == 1;
+}
+
+// 64 bit FNV-1a hash of a string, continuing from hash h
+static ::uint64_t Hash(const std::string& s, ::uint64_t h)
+{
+    for (unsigned int i=0;  i<s.size();  i++)
+        h = (h ^ (unsigned char)s[i]) * 0x100000001b3ull;
+    return h;
+}
+
+// The cache file of this program:  Named for a hash of everything that
+// goes into the binary, being the driver (GL_VERSION carries its
+// version) and the sources (with their defines) and attribute
+// bindings.  Empty if caching is off or unsupported.
+std::string ShaderProgram::CacheFile() const
+{
+    if (cacheDirectory.empty() || !BinariesSupported())
+        return "";
+
+    ::uint64_t h = 0xcbf29ce484222325ull;
+    h = Hash((const char*)glGetString(GL_VENDOR), h);
+    h = Hash((const char*)glGetString(GL_RENDERER), h);
+    h = Hash((const char*)glGetString(GL_VERSION), h);
+    char line[128];
+    for (unsigned int i=0;  i<sources.size();  i++) {
+        sprintf(line, "\nshader %d\n", sources[i].type);
+        h = Hash(sources[i].text, Hash(line, h)); }
+    for (unsigned int i=0;  i<attributes.size();  i++) {
+        sprintf(line, "\nattribute %d ", attributes[i].index);
+        h = Hash(attributes[i].name, Hash(line, h)); }
+
+    sprintf(line, "/%08x%08x.bin", (unsigned int)(h >> 32), (unsigned int)h);
+    return cacheDirectory + line;
+}
+
+// Try to load the program from a cache file, written by SaveBinary as
+// a header (magic, binary format, length) and the binary itself.  The
+// driver may still reject a binary;  The program is then left
+// unlinked, ready to be compiled as usual.
+bool ShaderProgram::LoadBinary(const std::string& fileName)
+{
+    FILE* f = fopen(fileName.c_str(), "rb");
+    if (!f) return false;
+
+    unsigned int header[3];
+    std::vector<char> binary;
+    bool ok = fread(header, sizeof(header), 1, f) == 1
+        && header[0] == BINARY_MAGIC && header[2] > 0;
+    if (ok) {
+        binary.resize(header[2]);
+        ok = fread(&binary[0], 1, header[2], f) == header[2]; }
+    fclose(f);
+    if (!ok) return false;
+
+    glProgramBinary(program, header[1], &binary[0], header[2]);
     int status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
-    
-    // If link failed, get and print log
-    if (status != 1) {
-        int length;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
-        char* buffer = new char[length];
-        glGetProgramInfoLog(program, length, NULL, buffer);
-        printf("Link log:\n%s\n", buffer);
-        delete buffer;
-    }
+    if (status != 1)
+        printf("Cached shader binary %s rejected;  Recompiling\n", fileName.c_str());
+    return status == 1;
+}
+
+// Write the linked program's binary to a cache file.  Failures only
+// cost the next run a compile, so they pass silently.
+void ShaderProgram::SaveBinary(const std::string& fileName)
+{
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+    MakeDirectory(cacheDirectory.c_str());
+    FILE* f = fopen(fileName.c_str(), "wb");
+    if (!f) return;
+    unsigned int header[3] = { BINARY_MAGIC, format, (unsigned int)length };
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1
+        && fwrite(&binary[0], 1, length, f) == (size_t)length;
+    fclose(f);
+    if (!ok) remove(fileName.c_str()); // Never leave a partial file
+}
+
+////////////////////////////////////////////////////////////////////////
+// Permutations
+
+// Declare a feature taking the next bits bits of the feature mask, and
+// return its shift.  Must precede CreateShader.
+int ShaderProgram::AddFeature(const char* name, const int bits)
+{
+    int shift = 0;
+    if (!features.empty())
+        shift = features.back().shift + features.back().bits;
+    Feature f = { name, shift, bits };
+    features.push_back(f);
+    return shift;
+}
+
+// The #define lines of this variant's features.
+std::string ShaderProgram::Defines() const
+{
+    std::string defines;
+    char line[128];
+    for (unsigned int i=0;  i<features.size();  i++) {
+        const Feature& f = features[i];
+        unsigned int value = (mask >> f.shift) & ((1u << f.bits) - 1);
+        sprintf(line, "#define %s %u\n", f.name.c_str(), value);
+        defines += line; }
+    return defines;
+}
+
+// Point a sampler uniform (by UniformId) at a fixed texture unit, in
+// this program and every variant, now and when later compiled.
+void ShaderProgram::SetSamplerUnit(const int id, const int unit)
+{
+    SamplerUnit su = { id, unit };
+    samplerUnits.push_back(su);
+    if (program && !pending) ApplySamplerUnits();
+    std::map<unsigned int, ShaderProgram*>::iterator it;
+    for (it=variants.begin();  it!=variants.end();  it++)
+        it->second->SetSamplerUnit(id, unit);
+}
+
+// Set the recorded sampler units, leaving the current program as is.
+void ShaderProgram::ApplySamplerUnits()
+{
+    if (samplerUnits.empty()) return;
+    int current;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    glUseProgram(program);
+    for (unsigned int i=0;  i<samplerUnits.size();  i++)
+        SetUniform(samplerUnits[i].id, samplerUnits[i].unit);
+    glUseProgram(current);
+}
+
+// The variant for feature mask m, submitted for compiling on first
+// use.  It may not be Ready yet.
+ShaderProgram* ShaderProgram::Variant(const unsigned int m)
+{
+    if (m == mask) return this;
+    std::map<unsigned int, ShaderProgram*>::iterator it = variants.find(m);
+    if (it != variants.end())
+        return it->second;
+
+    ShaderProgram* v = new ShaderProgram();
+    v->mask = m;
+    v->features = features;
+    v->samplerUnits = samplerUnits;
+    v->CreateProgram();
+    for (unsigned int i=0;  i<sources.size();  i++)
+        v->CreateShader(sources[i].fileName.c_str(), sources[i].type);
+    for (unsigned int i=0;  i<attributes.size();  i++)
+        v->BindAttribute(attributes[i].index, attributes[i].name.c_str());
+    v->LinkProgram();
+    variants[m] = v;
+    return v;
+}
+
+// The program to draw with for feature mask m:  Its variant once that
+// is ready, and until then (while it compiles) this program, waited
+// for if need be.
+ShaderProgram* ShaderProgram::Usable(const unsigned int m)
+{
+    ShaderProgram* v = Variant(m);
+    if (v->Ready())
+        return v;
+    Finish();
+    return this;
+}
+
+// Query all active uniforms of the linked program and record their
+// locations and types.  Uniforms inside uniform blocks have no
+// location and are not set through this table.
+void ShaderProgram::ReflectUniforms()
+{
+    uniforms.clear();
+    slots.clear();
+
+    int count, maxLength;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    char* name = new char[maxLength+1];
+
+    for (int i=0;  i<count;  i++) {
+        Uniform u;
+        GLenum type;
+        glGetActiveUniform(program, i, maxLength+1, NULL, &u.size, &type, name);
+        u.type = type;
+        u.location = glGetUniformLocation(program, name);
+        if (u.location < 0) continue;
+
+        // Arrays are reported as "name[0]";  Record them as "name".
+        char* bracket = strchr(name, '[');
+        if (bracket) *bracket = char(0);
+        u.name = name;
+        u.valid = false;
+
+        int id = UniformId(name);
+        if (id >= (int)slots.size())
+            slots.resize(id+1, -1);
+        slots[id] = (int)uniforms.size();
+        uniforms.push_back(u); }
+
+    delete[] name;
+}
+
+// Does a value of C++ type "type" fit a uniform of GL type "actual"?
+// Integer values are used for ints, bools and samplers alike.
+static bool TypeMatches(const unsigned int type, const unsigned int actual)
+{
+    if (type != GL_INT)
+        return type == actual;
+    return actual != GL_FLOAT && actual != GL_FLOAT_VEC2
+        && actual != GL_FLOAT_VEC3 && actual != GL_FLOAT_VEC4
+        && actual != GL_FLOAT_MAT2 && actual != GL_FLOAT_MAT3
+        && actual != GL_FLOAT_MAT4;
+}
+
+// Returns the uniform for id if its value differs from the shadowed
+// one (and updates the shadow), or NULL if the upload can be skipped.
+Uniform* ShaderProgram::Changed(const int id, const void* value,
+                                const int bytes, const unsigned int type)
+{
+    if (id < 0 || id >= (int)slots.size() || slots[id] < 0)
+        return NULL;            // Not active in this program
+
+    Uniform* u = &uniforms[slots[id]];
+    if (u->location < 0)
+        return NULL;
+
+    if (!TypeMatches(type, u->type)) {
+        printf("Uniform %s: type mismatch (0x%x set as 0x%x); ignored\n",
+               u->name.c_str(), u->type, type);
+        u->location = -1;
+        return NULL; }
+
+    if (u->valid && memcmp(u->shadow, value, bytes) == 0)
+        return NULL;            // Redundant upload
+
+    memcpy(u->shadow, value, bytes);
+    u->valid = true;
+    return u;
+}
+
+void ShaderProgram::SetUniform(const int id, const int value)
+{
+    Uniform* u = Changed(id, &value, sizeof(value), GL_INT);
+    if (u) glUniform1i(u->location, value);
+}
+
+void ShaderProgram::SetUniform(const int id, const float value)
+{
+    Uniform* u = Changed(id, &value, sizeof(value), GL_FLOAT);
+    if (u) glUniform1f(u->location, value);
+}
+
+void ShaderProgram::SetUniform(const int id, const glm::vec3& value)
+{
+    Uniform* u = Changed(id, &value[0], sizeof(value), GL_FLOAT_VEC3);
+    if (u) glUniform3fv(u->location, 1, &value[0]);
+}
+
+void ShaderProgram::SetUniform(const int id, const glm::vec4& value)
+{
+    Uniform* u = Changed(id, &value[0], sizeof(value), GL_FLOAT_VEC4);
+    if (u) glUniform4fv(u->location, 1, &value[0]);
+}
+
+void ShaderProgram::SetUniform(const int id, const glm::mat4& value)
+{
+    Uniform* u = Changed(id, &value[0][0], sizeof(value), GL_FLOAT_MAT4);
+    if (u) glUniformMatrix4fv(u->location, 1, GL_FALSE, &value[0][0]);
 }
@@ -6,17 +6,149 @@
 // invoked for all geometry passing through the graphics pipeline.
 // When done, unload it with method "Unuse".
 //
+// LinkProgram only starts the compile and link, so that every program
+// can be submitted at once and (on a driver with
+// KHR_parallel_shader_compile) built in the background.  Ready() asks
+// whether that is done without waiting;  Finish() waits for it, checks
+// for errors and sets up the linked program, and Use() calls Finish()
+// so that a program is only ever waited for when first needed.
+//
+// After linking, all active uniforms are reflected into a table, and
+// uniforms are then set through integer ids rather than by name:
+//    static int uColor = UniformId("phongDiffuse");   // Once
+//    shader.SetUniform(uColor, vec3(1,0,0));           // Per draw
+// Ids are shared by all programs, so one id works with any program
+// that declares that uniform (and is silently ignored by any that
+// does not).  Each program remembers the last value uploaded to each
+// of its uniforms and skips glUniform* calls that would not change
+// anything.  As with glUniform*, the program must be in use.
+//
+// Permutations:  A program may declare compile-time features, each a
+// field of one or more bits in a feature mask, before its shaders:
+//    shader.CreateProgram();
+//    int tex = shader.AddFeature("USE_TEXTURE");     // Bit 0
+//    int mode = shader.AddFeature("MODE", 4);        // Bits 1-4
+//    shader.CreateShader(...);  shader.BindAttribute(...);
+//    shader.LinkProgram();
+// Every feature is then injected into the sources, right after the
+// #version line, as "#define NAME value".  The program object itself
+// is the variant with all features 0.  Variant(mask) returns the one
+// for any other mask, compiling it from the recorded sources (and
+// attribute bindings and sampler units) the first time it is asked
+// for, and keeping it in the program's permutation table, so only the
+// variants actually drawn with are ever compiled.  Usable(mask) is
+// the one to draw with:  The variant once it is Ready, and this
+// program meanwhile, so that frames never stall on a new variant.
+// Variants must be asked for on the OpenGL thread.
+//
+// Binary cache:  Shaders are only read by CreateShader;  LinkProgram
+// first looks in cacheDirectory for a binary (glGetProgramBinary) of
+// the same sources, defines and attribute bindings made by the same
+// renderer and driver version, and compiles and links only if there
+// is none or the driver rejects it, then saving the new binary there.
+// An empty cacheDirectory (or a driver without program binaries)
+// turns the cache off.
+//
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
 
+#ifndef _SHADER
+#define _SHADER
+
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Uniform buffer binding point of the per-frame "FrameData" block
+// (framedata.glsl), attached automatically by LinkProgram.
+const unsigned int FRAME_DATA_BINDING = 0;
+
+// Returns the global id for a uniform name, assigning one on first use.
+int UniformId(const char* name);
+
+// One reflected active uniform, and a shadow copy of its last value.
+struct Uniform
+{
+    std::string name;
+    int location;
+    unsigned int type;          // GL_FLOAT_VEC3, GL_FLOAT_MAT4, ...
+    int size;                   // Array length (1 for non-arrays)
+    bool valid;                 // Has shadow been set by an upload?
+    float shadow[16];           // Bitwise copy of the last value sent
+};
+
 class ShaderProgram
 {
 public:
+    ShaderProgram();
+    ~ShaderProgram();
+
     int program;
-    
+    unsigned int mask;             // This variant's feature mask
+
+    std::vector<Uniform> uniforms; // Active uniforms found at link time
+    std::vector<int> slots;        // UniformId -> index in uniforms, or -1
+
     void CreateProgram();
     void CreateShader(const char* fileName, const int type);
+    void BindAttribute(const int index, const char* name);
     void LinkProgram();
+    bool Ready();
+    void Finish();
     void Use();
     void Unuse();
+
+    // Uniform uploads by id; skipped when the value is unchanged.
+    void SetUniform(const int id, const int value);
+    void SetUniform(const int id, const float value);
+    void SetUniform(const int id, const glm::vec3& value);
+    void SetUniform(const int id, const glm::vec4& value);
+    void SetUniform(const int id, const glm::mat4& value);
+
+    // Binary cache, and how many programs it has served or missed
+    static std::string cacheDirectory;
+    static int cached, compiled;
+
+    // Permutations
+    int AddFeature(const char* name, const int bits=1);
+    void SetSamplerUnit(const int id, const int unit);
+    ShaderProgram* Variant(const unsigned int mask);
+    ShaderProgram* Usable(const unsigned int mask);
+    int VariantCount() const { return (int)variants.size()+1; }
+
+private:
+    // Files holds the names of the text's #line source string numbers.
+    struct Source { std::string fileName;  int type;  std::string text;
+                    std::vector<std::string> files; };
+    struct Feature { std::string name;  int shift, bits; };
+    struct Attribute { int index;  std::string name; };
+    struct SamplerUnit { int id, unit; };
+
+    // The recipe every variant is built from
+    std::vector<Source> sources;
+    std::vector<Feature> features;
+    std::vector<Attribute> attributes;
+    std::vector<SamplerUnit> samplerUnits;
+    std::map<unsigned int, ShaderProgram*> variants;
+
+    // Between LinkProgram and Finish
+    bool pending;
+    std::vector<int> shaders;   // Compiling, rather than from a binary
+    std::string binaryFile;     // Cache file to save the binary to
+
+    std::string Defines() const;
+    void CompileShader(const Source& source);
+    std::string CacheFile() const;
+    bool LoadBinary(const std::string& fileName);
+    void SaveBinary(const std::string& fileName);
+    void ApplySamplerUnits();
+    ShaderProgram(const ShaderProgram&);     // Owns its variants;
+    ShaderProgram& operator=(const ShaderProgram&); //   Not copyable
+
+    void ReflectUniforms();
+    Uniform* Changed(const int id, const void* value, const int bytes,
+                     const unsigned int type);
 };
+
+#endif
@@ -0,0 +1,15 @@
+/////////////////////////////////////////////////////////////////////////
+// The lighting model, shared by the forward pass (lighting.frag) and
+// the deferred lighting pass (deferred.frag) so that both produce the
+// same image.  Include it with
+//    #include "shading.glsl"
+// N, L and E are the unit normal, light and eye vectors;  Kd, Ks and
+// alpha the diffuse and specular colors and the shininess.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+vec3 Shade(vec3 N, vec3 L, vec3 E, vec3 Kd, vec3 Ks, float alpha)
+{
+    return max(0.0, dot(L, N))*Kd;
+}
@@ -0,0 +1,456 @@
+///////////////////////////////////////////////////////////////////////
+// Mesh simplification by quadric error edge collapse;  See simplify.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <math.h>
+#include <stdio.h>
+
+#include "simplify.h"
+#include "meshopt.h"
+#include "meshlet.h"
+#include "workers.h"
+#include "cputrace.h"
+
+////////////////////////////////////////////////////////////////////////
+// A symmetric 4x4 matrix Q, for the error p^T Q p of a point p = (x,
+// y, z, 1):  The weighted sum of the squared distances from p to a set
+// of planes.
+struct Quadric
+{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+    Quadric() :a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+    // The plane through p with unit normal n, weighted by w
+    Quadric(const vec3& n, const vec3& p, const double w)
+    {
+        double a = n.x, b = n.y, c = n.z, d = -dot(n, p);
+        a2 = w*a*a;  ab = w*a*b;  ac = w*a*c;  ad = w*a*d;
+        b2 = w*b*b;  bc = w*b*c;  bd = w*b*d;
+        c2 = w*c*c;  cd = w*c*d;
+        d2 = w*d*d;
+    }
+
+    void operator+=(const Quadric& q)
+    {
+        a2 += q.a2;  ab += q.ab;  ac += q.ac;  ad += q.ad;
+        b2 += q.b2;  bc += q.bc;  bd += q.bd;
+        c2 += q.c2;  cd += q.cd;
+        d2 += q.d2;
+    }
+
+    double Error(const vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+                      + b2*y*y   + 2*bc*y*z + 2*bd*y
+                                 + c2*z*z   + 2*cd*z
+                                            + d2;
+    }
+};
+
+// A candidate collapse of u onto v, stale once either vertex has
+// changed since (its stamp having moved on).
+struct Collapse
+{
+    float cost;
+    unsigned int u, v;
+    unsigned int stampU, stampV;
+
+    bool operator>(const Collapse& o) const { return cost > o.cost; }
+};
+
+////////////////////////////////////////////////////////////////////////
+// One simplification run:  The triangles tris (indices into P and N,
+// of which the locked vertices must survive) are reduced to at most
+// target.
+class EdgeCollapser
+{
+public:
+    EdgeCollapser(const std::vector<vec3>& P, const std::vector<vec3>& N,
+                  const std::vector<unsigned char>& locked, std::vector<ivec3>& tris)
+        :P(P), N(N), locked(locked), tris(tris), quadrics(P.size()),
+         triangles(P.size()), border(P.size(), 0), stamps(P.size(), 0),
+         marks(P.size(), 0), token(0), dead(tris.size(), 0), live(0) {}
+
+    void Run(const unsigned int target);
+
+private:
+    const std::vector<vec3>& P;
+    const std::vector<vec3>& N;
+    const std::vector<unsigned char>& locked;
+    std::vector<ivec3>& tris;
+
+    std::vector<Quadric> quadrics;
+    std::vector< std::vector<unsigned int> > triangles; // Of each vertex
+    std::vector<unsigned char> border;
+    std::vector<unsigned int> stamps;
+    std::vector<unsigned int> marks;  // Scratch, for neighbor sets
+    unsigned int token;
+    std::vector<unsigned char> dead;
+    unsigned int live;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > queue;
+
+    void Setup();
+    void Push(const unsigned int u, const unsigned int v);
+    void PushNeighbors(const unsigned int v);
+    bool Valid(const unsigned int u, const unsigned int v);
+    void Apply(const unsigned int u, const unsigned int v);
+};
+
+// An edge (a < b) of triangle t, for finding shared and border edges
+struct EdgeRecord
+{
+    unsigned int a, b, t;
+    bool operator<(const EdgeRecord& o) const { return a < o.a || (a == o.a && b < o.b); }
+};
+
+// Quadrics, each vertex's triangles, borders, and the first candidates
+void EdgeCollapser::Setup()
+{
+    std::vector<EdgeRecord> edges;
+    edges.reserve(3*tris.size());
+    for (unsigned int t=0;  t<tris.size();  t++) {
+        const ivec3& tri = tris[t];
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]) {
+            dead[t] = 1;
+            continue; }
+        live++;
+
+        vec3 n = cross(P[tri[1]]-P[tri[0]], P[tri[2]]-P[tri[0]]);
+        float area2 = length(n);
+        Quadric q;
+        if (area2 > 0.0f)
+            q = Quadric(n/area2, P[tri[0]], 0.5*area2);
+        for (int c=0;  c<3;  c++) {
+            quadrics[tri[c]] += q;
+            triangles[tri[c]].push_back(t);
+            EdgeRecord e = { (unsigned int)std::min(tri[c], tri[(c+1)%3]),
+                             (unsigned int)std::max(tri[c], tri[(c+1)%3]), t };
+            edges.push_back(e); } }
+    std::sort(edges.begin(), edges.end());
+
+    for (unsigned int i=0;  i<edges.size();  ) {
+        unsigned int j = i+1;
+        while (j < edges.size() && edges[j].a == edges[i].a && edges[j].b == edges[i].b)
+            j++;
+        const EdgeRecord& e = edges[i];
+
+        // A border:  The plane through the edge, perpendicular to its
+        // only triangle.
+        if (j == i+1) {
+            const ivec3& tri = tris[e.t];
+            vec3 d = P[e.b] - P[e.a];
+            vec3 n = cross(d, cross(P[tri[1]]-P[tri[0]], P[tri[2]]-P[tri[0]]));
+            float len = length(n);
+            if (len > 0.0f) {
+                Quadric q(n/len, P[e.a], SIMPLIFY_BORDER_WEIGHT*dot(d, d));
+                quadrics[e.a] += q;
+                quadrics[e.b] += q; }
+            border[e.a] = border[e.b] = 1; }
+        i = j; }
+
+    for (unsigned int i=0;  i<edges.size();  i++)
+        if (i == 0 || edges[i].a != edges[i-1].a || edges[i].b != edges[i-1].b) {
+            Push(edges[i].a, edges[i].b);
+            Push(edges[i].b, edges[i].a); }
+}
+
+// Queue the collapse of u onto v, unless it is ruled out whatever
+// happens to the rest of the mesh.
+void EdgeCollapser::Push(const unsigned int u, const unsigned int v)
+{
+    if (locked[u] || (border[u] && !border[v]))
+        return;
+
+    Quadric q = quadrics[u];
+    q += quadrics[v];
+    double cost = q.Error(P[v]);
+    if (!N.empty()) {
+        vec3 d = P[u] - P[v];
+        cost += SIMPLIFY_NORMAL_WEIGHT*(1.0f - dot(N[u], N[v]))*dot(d, d)*dot(d, d); }
+
+    Collapse c = { (float)cost, u, v, stamps[u], stamps[v] };
+    queue.push(c);
+}
+
+// Queue both directions of every edge of v.
+void EdgeCollapser::PushNeighbors(const unsigned int v)
+{
+    token++;
+    marks[v] = token;
+    const std::vector<unsigned int>& list = triangles[v];
+    for (unsigned int i=0;  i<list.size();  i++)
+        for (int c=0;  c<3;  c++) {
+            unsigned int x = tris[list[i]][c];
+            if (marks[x] == token) continue;
+            marks[x] = token;
+            Push(v, x);
+            Push(x, v); }
+}
+
+// Can u collapse onto v, as the mesh stands now?
+bool EdgeCollapser::Valid(const unsigned int u, const unsigned int v)
+{
+    // Mark u's neighbors (with token-1), counting the triangles u and
+    // v share.
+    token += 2;
+    int shared = 0;
+    const std::vector<unsigned int>& list = triangles[u];
+    for (unsigned int i=0;  i<list.size();  i++) {
+        if (dead[list[i]]) continue;
+        const ivec3& tri = tris[list[i]];
+        if (tri[0] == (int)v || tri[1] == (int)v || tri[2] == (int)v)
+            shared++;
+        for (int c=0;  c<3;  c++)
+            marks[tri[c]] = token-1; }
+    if (shared == 0 || (border[u] && shared != 1))
+        return false;
+
+    // Link condition:  Their only common neighbors are the third
+    // corners of their shared triangles.
+    int common = 0;
+    const std::vector<unsigned int>& vlist = triangles[v];
+    for (unsigned int i=0;  i<vlist.size();  i++) {
+        if (dead[vlist[i]]) continue;
+        const ivec3& tri = tris[vlist[i]];
+        for (int c=0;  c<3;  c++) {
+            unsigned int x = tri[c];
+            if (x != u && x != v && marks[x] == token-1) {
+                marks[x] = token;
+                common++; } } }
+    if (common != shared)
+        return false;
+
+    // No triangle left with u may turn over, or much on its side.
+    for (unsigned int i=0;  i<list.size();  i++) {
+        if (dead[list[i]]) continue;
+        const ivec3& tri = tris[list[i]];
+        if (tri[0] == (int)v || tri[1] == (int)v || tri[2] == (int)v)
+            continue;
+        vec3 p[3], q[3];
+        for (int c=0;  c<3;  c++) {
+            p[c] = P[tri[c]];
+            q[c] = tri[c] == (int)u ? P[v] : p[c]; }
+        vec3 before = cross(p[1]-p[0], p[2]-p[0]);
+        vec3 after = cross(q[1]-q[0], q[2]-q[0]);
+        float lengths = length(before)*length(after);
+        if (lengths == 0.0f || dot(before, after) < SIMPLIFY_FLIP_COS*lengths)
+            return false; }
+    return true;
+}
+
+// Move u onto v:  The triangles they share go, and u's others become v's.
+void EdgeCollapser::Apply(const unsigned int u, const unsigned int v)
+{
+    quadrics[v] += quadrics[u];
+    stamps[u]++;
+    stamps[v]++;
+
+    std::vector<unsigned int>& list = triangles[u];
+    for (unsigned int i=0;  i<list.size();  i++) {
+        unsigned int t = list[i];
+        if (dead[t]) continue;
+        ivec3& tri = tris[t];
+        if (tri[0] == (int)v || tri[1] == (int)v || tri[2] == (int)v) {
+            dead[t] = 1;
+            live--;
+            continue; }
+        for (int c=0;  c<3;  c++)
+            if (tri[c] == (int)u) tri[c] = v;
+        triangles[v].push_back(t); }
+    std::vector<unsigned int>().swap(list);
+
+    std::vector<unsigned int>& vlist = triangles[v];
+    unsigned int n = 0;
+    for (unsigned int i=0;  i<vlist.size();  i++)
+        if (!dead[vlist[i]])
+            vlist[n++] = vlist[i];
+    vlist.resize(n);
+    PushNeighbors(v);
+}
+
+void EdgeCollapser::Run(const unsigned int target)
+{
+    Setup();
+    while (live > target && !queue.empty()) {
+        Collapse c = queue.top();
+        queue.pop();
+        // Stale entries were requeued with fresh costs when they went
+        // stale, and entries of removed vertices went stale then too.
+        if (c.stampU != stamps[c.u] || c.stampV != stamps[c.v])
+            continue;
+        if (Valid(c.u, c.v))
+            Apply(c.u, c.v); }
+
+    unsigned int n = 0;
+    for (unsigned int t=0;  t<tris.size();  t++)
+        if (!dead[t])
+            tris[n++] = tris[t];
+    tris.resize(n);
+}
+
+////////////////////////////////////////////////////////////////////////
+// The parallel pass:  Each grid cell's own triangles (all three
+// vertices in the cell), renumbered to the cell's vertices, reduced
+// by ratio.  Each vertex belongs to one cell, so each job writes only
+// its own vertices' entries of local.
+struct CellJobs
+{
+    const std::vector<vec3>* P;
+    const std::vector<vec3>* N;
+    const std::vector<unsigned char>* locked;
+    std::vector<unsigned int>* local;
+    std::vector< std::vector<ivec3> > cells;
+    float ratio;
+};
+
+static void SimplifyCell(int index, int, void* data)
+{
+    CPU_SCOPE("SimplifyCell");
+    CellJobs& jobs = *(CellJobs*)data;
+    std::vector<ivec3>& tris = jobs.cells[index];
+    if (tris.empty()) return;
+    std::vector<unsigned int>& local = *jobs.local;
+
+    std::vector<unsigned int> global;
+    std::vector<vec3> P, N;
+    std::vector<unsigned char> locked;
+    for (unsigned int t=0;  t<tris.size();  t++)
+        for (int c=0;  c<3;  c++) {
+            unsigned int g = tris[t][c];
+            if (local[g] == (unsigned int)-1) {
+                local[g] = global.size();
+                global.push_back(g);
+                P.push_back((*jobs.P)[g]);
+                if (!jobs.N->empty()) N.push_back((*jobs.N)[g]);
+                locked.push_back((*jobs.locked)[g]); }
+            tris[t][c] = local[g]; }
+
+    EdgeCollapser collapser(P, N, locked, tris);
+    collapser.Run((unsigned int)(jobs.ratio*tris.size()));
+
+    for (unsigned int t=0;  t<tris.size();  t++)
+        for (int c=0;  c<3;  c++)
+            tris[t][c] = global[tris[t][c]];
+}
+
+std::vector<ivec3> SimplifyTriangles(const Model& m, const unsigned int target)
+{
+    CPU_SCOPE("SimplifyTriangles");
+    std::vector<vec3> P(m.Pnt.size()), N;
+    for (unsigned int i=0;  i<m.Pnt.size();  i++)
+        P[i] = vec3(m.Pnt[i]);
+    if (m.Nrm.size() == m.Pnt.size())
+        N = m.Nrm;
+
+    std::vector<ivec3> tris = m.Tri;     // Quads are gone since MakeVAO.
+    if (tris.size() <= target || P.empty())
+        return tris;
+    std::vector<unsigned char> locked(P.size(), 0);
+
+    // Cut large meshes into a g by g by g grid of cells.
+    int g = (int)ceil(pow(tris.size()/double(SIMPLIFY_CELL_TRIANGLES), 1.0/3.0));
+    if (g > 1) {
+        vec3 lo = P[0], hi = P[0];
+        for (unsigned int i=1;  i<P.size();  i++) {
+            lo = min(lo, P[i]);
+            hi = max(hi, P[i]); }
+        vec3 extent = max(hi - lo, vec3(1e-6f));
+        std::vector<int> cell(P.size());
+        for (unsigned int i=0;  i<P.size();  i++) {
+            ivec3 c = min(ivec3(float(g)*(P[i]-lo)/extent), ivec3(g-1));
+            cell[i] = (c.z*g + c.y)*g + c.x; }
+
+        CellJobs jobs;
+        std::vector<unsigned int> local(P.size(), (unsigned int)-1);
+        std::vector<ivec3> seams;
+        jobs.cells.resize(g*g*g);
+        for (unsigned int t=0;  t<tris.size();  t++) {
+            const ivec3& tri = tris[t];
+            if (cell[tri[0]] == cell[tri[1]] && cell[tri[1]] == cell[tri[2]])
+                jobs.cells[cell[tri[0]]].push_back(tri);
+            else {
+                seams.push_back(tri);
+                locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = 1; } }
+
+        jobs.P = &P;
+        jobs.N = &N;
+        jobs.locked = &locked;
+        jobs.local = &local;
+        jobs.ratio = float(target)/tris.size();
+        workers.Run(g*g*g, SimplifyCell, &jobs);
+
+        tris.swap(seams);
+        for (unsigned int c=0;  c<jobs.cells.size();  c++)
+            tris.insert(tris.end(), jobs.cells[c].begin(), jobs.cells[c].end());
+        std::fill(locked.begin(), locked.end(), 0); }
+
+    // The whole mesh, seams and all
+    EdgeCollapser collapser(P, N, locked, tris);
+    collapser.Run(target);
+    return tris;
+}
+
+////////////////////////////////////////////////////////////////////////
+// The largest projected diameter, in pixels, at which the average
+// edge of m (of a model of half size "size") stays about
+// LOD_PIXELS_PER_SEGMENT pixels long.
+static float LodPixels(const Model& m, const float size)
+{
+    double total = 0.0;
+    for (unsigned int t=0;  t<m.Tri.size();  t++)
+        for (int c=0;  c<3;  c++)
+            total += length(vec3(m.Pnt[m.Tri[t][c]] - m.Pnt[m.Tri[t][(c+1)%3]]));
+    if (total == 0.0) return 0.0f;
+    return float(2.0*size*LOD_PIXELS_PER_SEGMENT/(total/(3*m.Tri.size())));
+}
+
+void BuildLods(Model& m, const char* name, const int levels, const float ratio)
+{
+    CPU_SCOPE("BuildLods");
+    m.lodPixels = LodPixels(m, m.size);
+    Model* finer = &m;
+    for (int k=1;  k<levels && k<MAX_LODS;  k++) {
+        unsigned int target = (unsigned int)(ratio*finer->Tri.size());
+        std::vector<ivec3> tris = SimplifyTriangles(*finer, target);
+        if (tris.empty() || tris.size() >= finer->Tri.size())
+            break;
+
+        // Keep only the vertices still used, in the same order.
+        Model* lod = new Model();
+        lod->simplified = true;
+        lod->diffuseColor = m.diffuseColor;
+        lod->specularColor = m.specularColor;
+        lod->shininess = m.shininess;
+        std::vector<int> remap(finer->Pnt.size(), -1);
+        for (unsigned int t=0;  t<tris.size();  t++)
+            for (int c=0;  c<3;  c++)
+                remap[tris[t][c]] = 0;
+        for (unsigned int i=0;  i<remap.size();  i++) {
+            if (remap[i] < 0) continue;
+            remap[i] = lod->Pnt.size();
+            lod->Pnt.push_back(finer->Pnt[i]);
+            if (i < finer->Nrm.size()) lod->Nrm.push_back(finer->Nrm[i]);
+            if (i < finer->Tex.size()) lod->Tex.push_back(finer->Tex[i]);
+            if (i < finer->Tan.size()) lod->Tan.push_back(finer->Tan[i]); }
+        for (unsigned int t=0;  t<tris.size();  t++)
+            lod->Tri.push_back(ivec3(remap[tris[t][0]], remap[tris[t][1]],
+                                     remap[tris[t][2]]));
+
+        char lodName[256];
+        sprintf(lodName, "%.200s LOD %d", name, k);
+        OptimizeMesh(*lod, lodName);
+        if (lod->Tri.size() >= MESHLET_MIN_TRIANGLES)
+            lod->meshlets = new Meshlets(*lod);
+        lod->ComputeSize();
+        lod->MakeVAO();
+        lod->lodPixels = LodPixels(*lod, m.size);
+        m.lods.push_back(lod);
+        finer = lod; }
+}
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////
+// Mesh simplification by edge collapse, after Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics", for building
+// the level of detail chains of models (such as PLY scans) that have
+// no procedural way to coarsen themselves.
+//
+// Each vertex carries a quadric:  The sum of the squared distances to
+// the planes of its triangles (weighted by area), plus, along borders
+// (edges of one triangle), planes through the border perpendicular to
+// the surface, weighted by SIMPLIFY_BORDER_WEIGHT.  An edge u-v
+// collapses by moving u onto v, at the cost of the summed quadric at
+// v plus a penalty for the angle between the two vertex normals.
+// Cheapest first (from a priority queue), edges collapse until the
+// triangle budget is met, except for those that would
+//   remove a locked vertex, or move a border vertex off the border,
+//   join two parts of the surface (the link condition), or
+//   tilt any triangle by more than SIMPLIFY_FLIP_COS allows.
+// The surviving vertices keep their own positions, normals and
+// texture coordinates, so a coarser level's vertices are a subset of
+// the finer one's.
+//
+// Large meshes are first cut by a grid into cells of about
+// SIMPLIFY_CELL_TRIANGLES, each simplified (toward the same budget
+// ratio) by its own job on the worker pool with the vertices of
+// triangles crossing cells locked, and then the whole mesh is
+// simplified once more, without locks, to meet the budget.
+//
+// Usage:
+//    std::vector<ivec3> tris = SimplifyTriangles(model, budget);
+// or, for levels 1 to levels-1 of a model, each with ratio times the
+// triangles of the one before (each marked Model::simplified, since
+// its triangles may bridge concave parts of the surface):
+//    BuildLods(model, name, levels, ratio);
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SIMPLIFY
+#define _SIMPLIFY
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+using namespace glm;
+
+const int SIMPLIFY_CELL_TRIANGLES = 16384;    // Per job of the parallel pass
+const float SIMPLIFY_BORDER_WEIGHT = 16.0f;   // Of border planes against faces
+const float SIMPLIFY_NORMAL_WEIGHT = 1.0f;    // Of the normal angle penalty
+const float SIMPLIFY_FLIP_COS = 0.2f;         // Least cosine of a triangle's tilt
+
+std::vector<ivec3> SimplifyTriangles(const Model& m, const unsigned int target);
+void BuildLods(Model& m, const char* name, const int levels, const float ratio);
+
+#endif
@@ -0,0 +1,270 @@
+///////////////////////////////////////////////////////////////////////
+// A bounding volume hierarchy over Model instances;  See spatial.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#include "spatial.h"
+
+const int LEAF_SIZE = 8;        // Objects per leaf (one AVX batch)
+
+void SpatialIndex::Clear()
+{
+    objects.clear();
+    nodes.clear();
+    order.clear();
+    slot.clear();
+    leaf.clear();
+    spheres.Clear();
+}
+
+// Add an object;  Build must be called before the next query.
+int SpatialIndex::Insert(Model* model, const mat4& tr)
+{
+    SceneObject o;
+    o.model = model;
+    o.modelTr = tr;
+    model->WorldBox(tr, o.boxCenter, o.boxExtent);
+    objects.push_back(o);
+    nodes.clear();
+    return (int)objects.size()-1;
+}
+
+// Orders object handles by one coordinate of their box centers.
+struct CenterLess
+{
+    const std::vector<SceneObject>* objects;
+    int axis;
+    bool operator()(const int a, const int b) const
+    { return (*objects)[a].boxCenter[axis] < (*objects)[b].boxCenter[axis]; }
+};
+
+////////////////////////////////////////////////////////////////////////
+// Build the hierarchy top down, splitting each range of objects at the
+// median along the longest axis of its box centers.
+void SpatialIndex::Build()
+{
+    const int n = objects.size();
+    nodes.clear();
+    order.resize(n);
+    slot.resize(n);
+    leaf.resize(n);
+    for (int i=0;  i<n;  i++)
+        order[i] = i;
+    if (n == 0) return;
+
+    nodes.reserve(2*n);     // Enough however full the leaves
+    BuildNode(0, n, -1);
+
+    // Bounding spheres in leaf order, for batch frustum tests
+    spheres.Clear();
+    for (int i=0;  i<n;  i++) {
+        const SceneObject& o = objects[order[i]];
+        vec3 c;
+        float r;
+        o.model->WorldSphere(o.modelTr, c, r);
+        spheres.Add(c, r);
+        slot[order[i]] = i; }
+}
+
+int SpatialIndex::BuildNode(const int first, const int count, const int parent)
+{
+    int index = nodes.size();
+    nodes.push_back(Node());
+    nodes[index].first = first;
+    nodes[index].count = count;
+    nodes[index].parent = parent;
+    nodes[index].left = nodes[index].right = -1;
+
+    if (count <= LEAF_SIZE) {
+        for (int i=first;  i<first+count;  i++)
+            leaf[order[i]] = index;
+        FitLeaf(nodes[index]);
+        return index; }
+
+    // Split along the longest axis of the centers' extent
+    vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (int i=first;  i<first+count;  i++) {
+        lo = min(lo, objects[order[i]].boxCenter);
+        hi = max(hi, objects[order[i]].boxCenter); }
+    vec3 d = hi-lo;
+    CenterLess less;
+    less.objects = &objects;
+    less.axis = (d.x > d.y && d.x > d.z) ? 0 : (d.y > d.z ? 1 : 2);
+    int half = count/2;
+    std::nth_element(order.begin()+first, order.begin()+first+half,
+                     order.begin()+first+count, less);
+
+    int left = BuildNode(first, half, index);
+    int right = BuildNode(first+half, count-half, index);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    nodes[index].minP = min(nodes[left].minP, nodes[right].minP);
+    nodes[index].maxP = max(nodes[left].maxP, nodes[right].maxP);
+    return index;
+}
+
+void SpatialIndex::FitLeaf(Node& n)
+{
+    n.minP = vec3(FLT_MAX);
+    n.maxP = vec3(-FLT_MAX);
+    for (int i=n.first;  i<n.first+n.count;  i++) {
+        const SceneObject& o = objects[order[i]];
+        n.minP = min(n.minP, o.boxCenter-o.boxExtent);
+        n.maxP = max(n.maxP, o.boxCenter+o.boxExtent); }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Move an object, then refit the boxes above it.  The tree's topology
+// is kept, so after very large movements a fresh Build gives tighter
+// boxes and faster queries.
+void SpatialIndex::Update(const int handle, const mat4& tr)
+{
+    SceneObject& o = objects[handle];
+    o.modelTr = tr;
+    o.model->WorldBox(tr, o.boxCenter, o.boxExtent);
+    if (nodes.empty()) return;
+
+    vec3 c;
+    float r;
+    o.model->WorldSphere(tr, c, r);
+    int s = slot[handle];
+    spheres.x[s] = c.x;
+    spheres.y[s] = c.y;
+    spheres.z[s] = c.z;
+    spheres.r[s] = r;
+
+    int n = leaf[handle];
+    FitLeaf(nodes[n]);
+    for (n = nodes[n].parent;  n >= 0;  n = nodes[n].parent) {
+        Node& node = nodes[n];
+        vec3 lo = min(nodes[node.left].minP, nodes[node.right].minP);
+        vec3 hi = max(nodes[node.left].maxP, nodes[node.right].maxP);
+        if (lo == node.minP && hi == node.maxP)
+            break;              // Nothing above here changes
+        node.minP = lo;
+        node.maxP = hi; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Append the handles of all objects (below node root) that may be
+// inside the frustum.
+void SpatialIndex::QueryFrustum(const Frustum& frustum, std::vector<int>& result,
+                                const int root) const
+{
+    if (nodes.empty()) return;
+
+    unsigned char visible[LEAF_SIZE];
+    int stack[64];
+    int top = 0;
+    stack[top++] = root;
+
+    while (top > 0) {
+        const Node& n = nodes[stack[--top]];
+        int c = frustum.ClassifyBox((n.minP+n.maxP)/2.0f, (n.maxP-n.minP)/2.0f);
+        if (c == FRUSTUM_OUTSIDE)
+            continue;
+
+        if (c == FRUSTUM_INSIDE) { // Accept the whole subtree
+            for (int i=n.first;  i<n.first+n.count;  i++)
+                result.push_back(order[i]); }
+
+        else if (n.left < 0) {     // Straddling leaf:  Batch test
+            frustum.CullSpheres(spheres, n.first, n.count, visible);
+            for (int i=0;  i<n.count;  i++)
+                if (visible[i]) result.push_back(order[n.first+i]); }
+
+        else {
+            stack[top++] = n.left;
+            stack[top++] = n.right; } }
+}
+
+// Split the hierarchy into (at most) want disjoint subtrees which
+// together cover all objects, by repeatedly replacing the largest
+// subtree with its two children.
+void SpatialIndex::Subtrees(const int want, std::vector<int>& roots) const
+{
+    roots.clear();
+    if (nodes.empty()) return;
+    roots.push_back(0);
+    while ((int)roots.size() < want) {
+        int largest = 0;
+        for (unsigned int i=1;  i<roots.size();  i++)
+            if (nodes[roots[i]].count > nodes[roots[largest]].count)
+                largest = i;
+        const Node& n = nodes[roots[largest]];
+        if (n.left < 0) break;  // Only leaves left
+        roots[largest] = n.left;
+        roots.push_back(n.right); }
+}
+
+// Append the handles of all objects below node root, without culling.
+void SpatialIndex::Objects(const int root, std::vector<int>& result) const
+{
+    if (nodes.empty()) return;
+    const Node& n = nodes[root];
+    result.insert(result.end(), order.begin()+n.first, order.begin()+n.first+n.count);
+}
+
+// Ray/box slab test;  Returns the entry distance, or FLT_MAX for a miss.
+// A ray parallel to a slab (infinite invDir) is inside it or never is;
+// Its (possibly 0*inf = NaN) distances are never computed.
+static float RayBox(const vec3& o, const vec3& invDir, const vec3& lo, const vec3& hi)
+{
+    float enter = 0.0f, leave = FLT_MAX;
+    for (int k=0;  k<3;  k++) {
+        if (fabs(invDir[k]) > FLT_MAX) {
+            if (o[k] < lo[k] || o[k] > hi[k]) return FLT_MAX;
+            continue; }
+        float t0 = (lo[k]-o[k])*invDir[k];
+        float t1 = (hi[k]-o[k])*invDir[k];
+        enter = max(enter, min(t0, t1));
+        leave = min(leave, max(t0, t1)); }
+    return enter <= leave ? enter : FLT_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Find the object whose bounding box is hit first by the ray
+// origin+t*dir (t>=0).  Returns its handle and sets t, or returns -1.
+// Subtrees farther than the best hit so far are skipped.
+int SpatialIndex::RayCast(const vec3& origin, const vec3& dir, float& t) const
+{
+    int best = -1;
+    t = FLT_MAX;
+    if (nodes.empty()) return best;
+
+    vec3 invDir = 1.0f/dir;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& n = nodes[stack[--top]];
+        if (RayBox(origin, invDir, n.minP, n.maxP) >= t)
+            continue;
+
+        if (n.left < 0) {
+            for (int i=n.first;  i<n.first+n.count;  i++) {
+                const SceneObject& o = objects[order[i]];
+                float h = RayBox(origin, invDir, o.boxCenter-o.boxExtent,
+                                 o.boxCenter+o.boxExtent);
+                if (h < t) {
+                    t = h;
+                    best = order[i]; } } }
+        else {
+            // Visit the nearer child first
+            float l = RayBox(origin, invDir, nodes[n.left].minP, nodes[n.left].maxP);
+            float r = RayBox(origin, invDir, nodes[n.right].minP, nodes[n.right].maxP);
+            if (l < r) {
+                stack[top++] = n.right;
+                stack[top++] = n.left; }
+            else {
+                stack[top++] = n.left;
+                stack[top++] = n.right; } } }
+
+    return best;
+}
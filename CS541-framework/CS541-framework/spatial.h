@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////
+// A spatial index over many instances of Models:  A bounding volume
+// hierarchy (BVH) of axis aligned boxes.  Objects are added with
+// "Insert", and "Build" creates the hierarchy.  After that:
+//
+//   * QueryFrustum finds all objects that may be visible.  Subtrees
+//     entirely inside the frustum are accepted without further tests,
+//     and objects in leaves that straddle its boundary are tested in
+//     SIMD batches (Frustum::CullSpheres).
+//     Queries may run on several threads at once:  "Subtrees" splits
+//     the hierarchy into disjoint subtrees, each of which can be
+//     queried separately (the third argument of QueryFrustum).
+//   * RayCast finds the nearest object whose bounding box a ray hits.
+//   * Update moves one object and refits only the boxes on the path
+//     from its leaf to the root, stopping as soon as a box is
+//     unchanged, so moving objects costs O(log n) each.
+//
+// Objects are identified by the handle returned by Insert, which
+// stays valid across Build and Update.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SPATIAL
+#define _SPATIAL
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "models.h"
+#include "frustum.h"
+
+using namespace glm;
+
+// One indexed object and its world-space bounds.
+struct SceneObject
+{
+    Model* model;
+    mat4 modelTr;
+    vec3 boxCenter, boxExtent;
+};
+
+class SpatialIndex
+{
+public:
+    std::vector<SceneObject> objects;  // Indexed by handle
+
+    void Clear();
+    int Insert(Model* model, const mat4& tr);
+    void Build();
+    void Update(const int handle, const mat4& tr);
+
+    void QueryFrustum(const Frustum& frustum, std::vector<int>& result,
+                      const int root=0) const;
+    void Subtrees(const int want, std::vector<int>& roots) const;
+    void Objects(const int root, std::vector<int>& result) const;
+    int RayCast(const vec3& origin, const vec3& dir, float& t) const;
+
+private:
+    // Every node covers the contiguous range [first, first+count) of
+    // the objects in leaf order;  Leaves have no children (left<0).
+    struct Node
+    {
+        vec3 minP, maxP;
+        int first, count;
+        int left, right, parent;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> order;     // Handles in leaf order
+    std::vector<int> slot;      // Handle -> position in order
+    std::vector<int> leaf;      // Handle -> leaf node
+    SphereBatch spheres;        // Bounding spheres, in leaf order
+
+    int BuildNode(const int first, const int count, const int parent);
+    void FitLeaf(Node& n);
+};
+
+#endif
@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////
+// Interleaved vertex buffers:  The OpenGL side of VertexBuilder.  See
+// vertexbuffer.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "vertexbuffer.h"
+
+int PresentAttributes(const VertexSources& s)
+{
+    if (!VertexLayout<Position>::Present(s)) return 0;
+    if (!VertexLayout<Normal>::Present(s)) return 1;
+    if (!VertexLayout<TexCoord>::Present(s)) return 2;
+    if (!VertexLayout<Tangent>::Present(s)) return 3;
+    return 4;
+}
+
+short PackSnorm16(const float x)
+{
+    return (short)floor(clamp(x, -1.0f, 1.0f)*32767.0f + 0.5f);
+}
+
+// Signed normalized x, y and z in 10 bits each, low bits first
+unsigned int PackSnorm10(const vec3& v)
+{
+    unsigned int packed = 0;
+    for (int c=0;  c<3;  c++) {
+        int q = (int)floor(clamp(v[c], -1.0f, 1.0f)*511.0f + 0.5f);
+        packed |= ((unsigned int)q & 0x3ff) << (10*c); }
+    return packed;
+}
+
+unsigned short PackUnorm16(const float x)
+{
+    return (unsigned short)floor(clamp(x, 0.0f, 1.0f)*65535.0f + 0.5f);
+}
+
+VertexPacking Packing(const VertexSources& s)
+{
+    for (unsigned int i=0;  i<s.Tex.size;  i++)
+        if (s.Tex[i].x < 0.0f || s.Tex[i].x > 1.0f || s.Tex[i].y < 0.0f || s.Tex[i].y > 1.0f)
+            return PACK_FLOAT_TEXCOORDS;
+    return PACK_ALL;
+}
+
+// Create and map a buffer of the given size (bound to target, which
+// for the element array is part of the bound VAO's state).
+static void* MapNewBuffer(const GLenum target, const unsigned int buffer,
+                          const unsigned int bytes)
+{
+    glBindBuffer(target, buffer);
+    glBufferData(target, bytes, NULL, GL_STATIC_DRAW);
+    if (!bytes) return NULL;
+    return glMapBufferRange(target, 0, bytes,
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+// Create the VAO and its buffers, and map the buffers for writing.
+VertexBufferBuilder::VertexBufferBuilder(const unsigned int _vertexCapacity,
+                                         const unsigned int _stride,
+                                         const unsigned int _indexCapacity,
+                                         const bool shortIndices)
+    :indexType(shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT),
+     vertexCount(0), vertexCapacity(_vertexCapacity), stride(_stride),
+     indexCount(0), indexCapacity(_indexCapacity),
+     indexSize(shortIndices ? sizeof(unsigned short) : sizeof(unsigned int))
+{
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vertexBuffer);
+    glGenBuffers(1, &indexBuffer);
+
+    glBindVertexArray(vao);
+    vertices = (char*)MapNewBuffer(GL_ARRAY_BUFFER, vertexBuffer, vertexCapacity*stride);
+    indices = (char*)MapNewBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer,
+                                  indexSize*indexCapacity);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// The next n vertices' place in the mapped vertex buffer.
+char* VertexBufferBuilder::Reserve(const unsigned int n)
+{
+    if (vertexCount + n > vertexCapacity) {
+        printf("VertexBuilder Error: %u vertices written to room for %u\n",
+               vertexCount + n, vertexCapacity);
+        exit(-1); }
+    char* v = vertices + vertexCount*stride;
+    vertexCount += n;
+    return v;
+}
+
+void VertexBufferBuilder::AddIndices(const unsigned int* source, const unsigned int n)
+{
+    if (indexCount + n > indexCapacity) {
+        printf("VertexBuilder Error: %u indices written to room for %u\n",
+               indexCount + n, indexCapacity);
+        exit(-1); }
+    if (indexType == GL_UNSIGNED_INT)
+        memcpy(indices + indexCount*indexSize, source, indexSize*n);
+    else
+        for (unsigned int i=0;  i<n;  i++)
+            ((unsigned short*)indices)[indexCount+i] = (unsigned short)source[i];
+    indexCount += n;
+}
+
+// Unmap both buffers and point the VAO's attributes into the vertex
+// buffer.  A buffer whose contents were lost while mapped (which
+// glUnmapBuffer reports, and which a change of display mode can cause)
+// can't be written again, since the sources are not kept.
+unsigned int VertexBufferBuilder::Finish(const VertexAttribute* attributes, const int count)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    bool ok = true;
+    if (vertices)
+        ok = glUnmapBuffer(GL_ARRAY_BUFFER) && ok;
+    if (indices)
+        ok = glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) && ok;
+    if (!ok)
+        printf("VertexBuilder Error: Buffer contents lost while mapped\n");
+    vertices = NULL;
+    indices = NULL;
+
+    // Packed formats are normalized, so shaders read floats either way.
+    for (int i=0;  i<count;  i++) {
+        const VertexAttribute& a = attributes[i];
+        GLenum type = GL_FLOAT;
+        switch (a.format) {
+        case VERTEX_UNORM16: type = GL_UNSIGNED_SHORT;  break;
+        case VERTEX_SNORM16: type = GL_SHORT;  break;
+        case VERTEX_SNORM10: type = GL_INT_2_10_10_10_REV;  break;
+        default: break; }
+        glEnableVertexAttribArray(a.slot);
+        glVertexAttribPointer(a.slot, a.components, type, a.format != VERTEX_FLOAT,
+                              stride, (void*)(size_t)a.offset); }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vao;
+}
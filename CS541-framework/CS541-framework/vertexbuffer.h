@@ -0,0 +1,313 @@
+///////////////////////////////////////////////////////////////////////
+// Interleaved vertex buffers, built straight from a model's arrays.
+//
+// A vertex layout is a compile-time list of attributes, each of which
+// names its slot (as listed in models.h), how it is stored, and the
+// model array it is read from:
+//    typedef VertexLayout<Position, Normal, TexCoord, Tangent> LayoutPNTT;
+// A layout's vertices are packed back to back, LayoutPNTT::stride bytes
+// each, with the attributes in the order listed.
+//
+// Each attribute comes in full (float) and packed forms:
+//    Position  vec4 (16 bytes)  PackedPosition  4 x snorm16 (8 bytes)
+//    Normal    vec3 (12 bytes)  PackedNormal    snorm 10/10/10/2 (4)
+//    TexCoord  vec2 (8 bytes)   PackedTexCoord  2 x unorm16 (4)
+//    Tangent   vec3 (12 bytes)  PackedTangent   snorm 10/10/10/2 (4)
+// so a packed vertex takes 20 bytes instead of 48.  A packed position
+// is stored relative to the mesh's bounds, as (P - center)/scale with
+// VertexSources::positionDecode = (center, scale) chosen so that every
+// position falls in [-1,1];  The vertex shader undoes that with the
+// same decode vector (lighting.vert's positionDecode).  Packed normals
+// and tangents come out of normalization slightly off unit length, and
+// are renormalized in the shaders anyway.  Packed texture coordinates
+// must be within [0,1] (see Packing), and a mesh with any outside
+// keeps them as floats alongside its other attributes packed;  They
+// are 16 bit fixed point rather than half floats, whose 11 bits near
+// 1.0 are off by a texel or more once a large texture is tiled.
+//
+// A VertexBuilder for a layout creates a VAO with one vertex buffer
+// and one index buffer, maps both, and writes vertices and indices
+// directly into them from VertexSources, which are spans (pointer and
+// size) into the caller's arrays.  Nothing is copied on the way but
+// into the mapped buffers themselves:
+//    VertexBuilder<LayoutPNTT> builder(vertexCount, indexCount, shortIndices);
+//    unsigned int base = builder.AddVertices(VertexSources(model));
+//    builder.AddIndices(&model.Tri[0][0], 3*model.Tri.size());
+//    ...                                 // More meshes, if room was made
+//    unsigned int vao = builder.Finish(); // Unmaps, and sets up the VAO
+// Indices are stored as 16 bits (builder.indexType GL_UNSIGNED_SHORT)
+// if asked for, which only works if each mesh (indices being relative
+// to its own first vertex) has at most MAX_SHORT_INDEX_VERTICES.
+//
+// Every model here has its attributes as a prefix of position,
+// normal, texture coordinate and tangent;  PresentAttributes counts
+// them, and WithLayout calls a builder's Build<L>() for the layout L
+// of that many attributes, full or packed (VertexPacking).
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _VERTEXBUFFER
+#define _VERTEXBUFFER
+
+#include <string.h>
+#include <glm/glm.hpp>
+
+#include "models.h"
+
+using namespace glm;
+
+const unsigned int MAX_SHORT_INDEX_VERTICES = 65536;
+
+// A read-only view of an array owned elsewhere
+template <class T> struct Span
+{
+    const T* data;
+    unsigned int size;
+
+    Span() :data(NULL), size(0) {}
+    Span(const T* d, const unsigned int n) :data(d), size(n) {}
+    Span(const std::vector<T>& v) :data(v.empty() ? NULL : &v[0]), size(v.size()) {}
+    const T& operator[](const unsigned int i) const { return data[i]; }
+};
+
+// The vertex arrays of one mesh.  All present arrays have Pnt.size
+// elements;  The others are empty.
+struct VertexSources
+{
+    Span<vec4> Pnt;
+    Span<vec3> Nrm;
+    Span<vec2> Tex;
+    Span<vec3> Tan;
+    vec4 positionDecode;        // Center and scale of packed positions
+
+    VertexSources() :positionDecode(0.0f, 0.0f, 0.0f, 1.0f) {}
+    VertexSources(const Model& m) :Pnt(m.Pnt), Nrm(m.Nrm), Tex(m.Tex), Tan(m.Tan),
+                                   positionDecode(m.positionDecode) {}
+};
+
+// How the components of an attribute are stored
+enum VertexFormat { VERTEX_FLOAT, VERTEX_UNORM16, VERTEX_SNORM16, VERTEX_SNORM10 };
+
+// One attribute of a vertex, as passed to glVertexAttribPointer
+struct VertexAttribute
+{
+    int slot;
+    int components;
+    VertexFormat format;
+    int offset;                 // Bytes from the start of the vertex
+};
+
+// Conversions for the packed attributes
+short PackSnorm16(const float x);
+unsigned short PackUnorm16(const float x);
+unsigned int PackSnorm10(const vec3& v);  // GL_INT_2_10_10_10_REV, w = 0
+
+////////////////////////////////////////////////////////////////////////
+// The attributes:  Slot, storage, and source array.
+
+// Stored as the source's own floats
+template <int SLOT, class T, Span<T> VertexSources::*SOURCE> struct FloatAttribute
+{
+    enum { slot = SLOT, components = sizeof(T)/sizeof(float), size = sizeof(T) };
+    static const VertexFormat format = VERTEX_FLOAT;
+    static const Span<T>& From(const VertexSources& s) { return s.*SOURCE; }
+    static void Write(char* dst, const VertexSources& s, const unsigned int i)
+        { memcpy(dst, &(s.*SOURCE)[i], size); }
+};
+
+typedef FloatAttribute<0, vec4, &VertexSources::Pnt> Position;
+typedef FloatAttribute<1, vec3, &VertexSources::Nrm> Normal;
+typedef FloatAttribute<2, vec2, &VertexSources::Tex> TexCoord;
+typedef FloatAttribute<3, vec3, &VertexSources::Tan> Tangent;
+
+// Relative to the bounds, in 16 bits per coordinate (w unused)
+struct PackedPosition
+{
+    enum { slot = 0, components = 4, size = 4*sizeof(short) };
+    static const VertexFormat format = VERTEX_SNORM16;
+    static const Span<vec4>& From(const VertexSources& s) { return s.Pnt; }
+    static void Write(char* dst, const VertexSources& s, const unsigned int i)
+    {
+        vec3 p = (vec3(s.Pnt[i]) - vec3(s.positionDecode))/s.positionDecode.w;
+        short q[4] = { PackSnorm16(p.x), PackSnorm16(p.y), PackSnorm16(p.z), 0 };
+        memcpy(dst, q, size);
+    }
+};
+
+// A direction in 10 bits per coordinate
+template <int SLOT, Span<vec3> VertexSources::*SOURCE> struct PackedDirection
+{
+    enum { slot = SLOT, components = 4, size = sizeof(unsigned int) };
+    static const VertexFormat format = VERTEX_SNORM10;
+    static const Span<vec3>& From(const VertexSources& s) { return s.*SOURCE; }
+    static void Write(char* dst, const VertexSources& s, const unsigned int i)
+    {
+        unsigned int q = PackSnorm10((s.*SOURCE)[i]);
+        memcpy(dst, &q, size);
+    }
+};
+
+typedef PackedDirection<1, &VertexSources::Nrm> PackedNormal;
+typedef PackedDirection<3, &VertexSources::Tan> PackedTangent;
+
+// Within [0,1], in 16 bits per coordinate
+struct PackedTexCoord
+{
+    enum { slot = 2, components = 2, size = 2*sizeof(unsigned short) };
+    static const VertexFormat format = VERTEX_UNORM16;
+    static const Span<vec2>& From(const VertexSources& s) { return s.Tex; }
+    static void Write(char* dst, const VertexSources& s, const unsigned int i)
+    {
+        unsigned short q[2] = { PackUnorm16(s.Tex[i].x), PackUnorm16(s.Tex[i].y) };
+        memcpy(dst, q, size);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////
+// A layout, as a list of attributes:  Its stride and attribute count,
+// writing one vertex, and describing its attributes for the VAO.
+template <class... Attributes> struct VertexLayout;
+
+template <> struct VertexLayout<>
+{
+    enum { stride = 0, count = 0 };
+    static bool Present(const VertexSources&) { return true; }
+    static void Write(char*, const VertexSources&, const unsigned int) {}
+    static void Describe(VertexAttribute*, const int) {}
+};
+
+template <class A, class... Rest> struct VertexLayout<A, Rest...>
+{
+    typedef VertexLayout<Rest...> Tail;
+    enum { stride = A::size + Tail::stride,
+           count = 1 + Tail::count };
+
+    // Does s have every attribute of this layout?
+    static bool Present(const VertexSources& s)
+    {
+        return A::From(s).size == s.Pnt.size && Tail::Present(s);
+    }
+
+    // Write vertex i of s at dst.
+    static void Write(char* dst, const VertexSources& s, const unsigned int i)
+    {
+        A::Write(dst, s, i);
+        Tail::Write(dst + A::size, s, i);
+    }
+
+    static void Describe(VertexAttribute* a, const int offset)
+    {
+        a->slot = A::slot;
+        a->components = A::components;
+        a->format = A::format;
+        a->offset = offset;
+        Tail::Describe(a+1, offset + A::size);
+    }
+};
+
+typedef VertexLayout<Position> LayoutP;
+typedef VertexLayout<Position, Normal> LayoutPN;
+typedef VertexLayout<Position, Normal, TexCoord> LayoutPNT;
+typedef VertexLayout<Position, Normal, TexCoord, Tangent> LayoutPNTT;
+
+typedef VertexLayout<PackedPosition> PackedP;
+typedef VertexLayout<PackedPosition, PackedNormal> PackedPN;
+typedef VertexLayout<PackedPosition, PackedNormal, PackedTexCoord> PackedPNT;
+typedef VertexLayout<PackedPosition, PackedNormal, PackedTexCoord, PackedTangent> PackedPNTT;
+typedef VertexLayout<PackedPosition, PackedNormal, TexCoord> PackedPNfT;
+typedef VertexLayout<PackedPosition, PackedNormal, TexCoord, PackedTangent> PackedPNfTT;
+
+// The number of leading attributes (of position, normal, texture
+// coordinate and tangent) s has.
+int PresentAttributes(const VertexSources& s);
+
+// How s can be stored packed:  PACK_ALL if its texture coordinates
+// are within [0,1], and PACK_FLOAT_TEXCOORDS otherwise.
+VertexPacking Packing(const VertexSources& s);
+
+// Call build.Build<L>() with the layout L of the given number of
+// leading attributes, full or packed.
+template <class B> void WithLayout(const int attributes, const VertexPacking packing,
+                                   B& build)
+{
+    if (packing != PACK_NONE)
+        switch (attributes) {
+        case 1:  build.template Build<PackedP>();  break;
+        case 2:  build.template Build<PackedPN>();  break;
+        case 3:
+            if (packing == PACK_ALL) build.template Build<PackedPNT>();
+            else build.template Build<PackedPNfT>();
+            break;
+        default:
+            if (packing == PACK_ALL) build.template Build<PackedPNTT>();
+            else build.template Build<PackedPNfTT>();
+            break; }
+    else
+        switch (attributes) {
+        case 1:  build.template Build<LayoutP>();  break;
+        case 2:  build.template Build<LayoutPN>();  break;
+        case 3:  build.template Build<LayoutPNT>();  break;
+        default: build.template Build<LayoutPNTT>();  break; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// The OpenGL side, shared by all layouts:  The VAO, its two buffers,
+// and their mappings while building.
+class VertexBufferBuilder
+{
+public:
+    unsigned int vao, vertexBuffer, indexBuffer;
+    unsigned int indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+
+    // Append indices, as they are (relative to the vertex their mesh
+    // starts at).  Quads are split into triangles before this (see
+    // Triangulate in meshopt.h).
+    void AddIndices(const unsigned int* indices, const unsigned int n);
+    void AddIndices(const int* indices, const unsigned int n)
+        { AddIndices((const unsigned int*)indices, n); }
+
+protected:
+    char* vertices;             // The mapped buffers
+    char* indices;
+    unsigned int vertexCount, vertexCapacity, stride;
+    unsigned int indexCount, indexCapacity, indexSize;
+
+    VertexBufferBuilder(const unsigned int vertexCapacity, const unsigned int stride,
+                        const unsigned int indexCapacity, const bool shortIndices);
+    char* Reserve(const unsigned int n);
+    unsigned int Finish(const VertexAttribute* attributes, const int count);
+
+private:
+    VertexBufferBuilder(const VertexBufferBuilder&);   // Owns mappings;
+    VertexBufferBuilder& operator=(const VertexBufferBuilder&); // Not copyable
+};
+
+template <class Layout> class VertexBuilder: public VertexBufferBuilder
+{
+public:
+    // Room for exactly vertexCapacity vertices and indexCapacity indices
+    VertexBuilder(const unsigned int vertexCapacity, const unsigned int indexCapacity,
+                  const bool shortIndices=false)
+        :VertexBufferBuilder(vertexCapacity, Layout::stride, indexCapacity, shortIndices) {}
+
+    // Write the vertices of one mesh, returning the index of its first.
+    unsigned int AddVertices(const VertexSources& s)
+    {
+        unsigned int base = vertexCount;
+        char* v = Reserve(s.Pnt.size);
+        for (unsigned int i=0;  i<s.Pnt.size;  i++, v+=Layout::stride)
+            Layout::Write(v, s, i);
+        return base;
+    }
+
+    // Unmap the buffers, and return the VAO, ready to draw.
+    unsigned int Finish()
+    {
+        VertexAttribute attributes[Layout::count];
+        Layout::Describe(attributes, 0);
+        return VertexBufferBuilder::Finish(attributes, Layout::count);
+    }
+};
+
+#endif
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////
+// A small pool of persistent worker threads;  See workers.h.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+
+#include "workers.h"
+#include "cputrace.h"
+
+WorkerPool workers;
+
+void WorkerPool::Start(int n)
+{
+    Stop();
+    if (n <= 0)
+        n = std::thread::hardware_concurrency();
+    running = true;
+    for (int i=1;  i<n;  i++)
+        threads.push_back(std::thread(&WorkerPool::Loop, this, i));
+}
+
+void WorkerPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    for (unsigned int i=0;  i<threads.size();  i++)
+        threads[i].join();
+    threads.clear();
+}
+
+// Take job indices until there are none left.
+void WorkerPool::Work(const int thread, JobFunction f, void* d, const int n)
+{
+    int i;
+    while ((i = next++) < n) {
+        f(i, thread, d);
+        if (++finished == n) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all(); } }
+}
+
+// A worker thread sleeps until a new batch is posted (or the pool is
+// stopped), then helps with it, with its own copy of the batch.
+void WorkerPool::Loop(const int thread)
+{
+    char name[32];
+    sprintf(name, "Worker %d", thread);
+    cpuTrace.NameThread(name);
+
+    unsigned int seen = 0;
+    while (true) {
+        JobFunction f;
+        void* d;
+        int n;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (running && generation == seen)
+                wake.wait(lock);
+            if (!running) return;
+            seen = generation;
+            f = job;
+            d = data;
+            n = count;
+            active++;
+        }
+        Work(thread, f, d, n);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0)
+                done.notify_all();
+        }
+    }
+}
+
+void WorkerPool::Run(const int n, JobFunction f, void* d)
+{
+    if (n <= 0) return;
+    if (threads.empty() || n == 1) { // Not worth waking anyone
+        for (int i=0;  i<n;  i++)
+            f(i, 0, d);
+        return; }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (active > 0)      // A late waker from the last batch
+            done.wait(lock);
+        job = f;
+        data = d;
+        count = n;
+        next = 0;
+        finished = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    Work(0, f, d, n);
+
+    // Every job done, and every worker out of Work
+    std::unique_lock<std::mutex> lock(mutex);
+    while (finished < n || active > 0)
+        done.wait(lock);
+}
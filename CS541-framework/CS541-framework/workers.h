@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////
+// A small pool of persistent worker threads for splitting per-frame
+// CPU work into jobs.  Method "Run" hands out job indices 0..count-1
+// to the workers and to the calling thread, and returns when all jobs
+// are done:
+//    void Job(int index, int thread, void* data) { ... }
+//    workers.Run(count, Job, &data);
+// The thread argument (0 for the caller, 1..Threads()-1 for workers)
+// lets a job write into per-thread storage without locking.  Jobs
+// must never make OpenGL calls;  The context belongs to the caller.
+//
+// Copyright 2013 DigiPen Institute of Technology
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _WORKERS
+#define _WORKERS
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+typedef void (*JobFunction)(int index, int thread, void* data);
+
+class WorkerPool
+{
+public:
+    WorkerPool() :running(false), generation(0), job(NULL), data(NULL), count(0), active(0) {}
+    ~WorkerPool() { Stop(); }
+
+    void Start(int threads=0);  // Total threads;  0 means one per core
+    void Stop();
+    int Threads() const { return (int)threads.size()+1; }
+
+    void Run(const int count, JobFunction job, void* data);
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool running;
+    unsigned int generation;    // Incremented for each Run
+
+    // The current batch of jobs;  Workers copy job, data and count
+    // under the mutex, and Run resets next and finished only once no
+    // worker is left inside Work, so a straggler can never take an
+    // index of the next batch.
+    JobFunction job;
+    void* data;
+    int count;
+    int active;                 // Workers inside Work (under the mutex)
+    std::atomic<int> next;      // Next job index to hand out
+    std::atomic<int> finished;  // Jobs completed
+
+    void Work(const int thread, JobFunction f, void* d, const int n);
+    void Loop(const int thread);
+};
+
+// The pool shared by all per-frame work.
+extern WorkerPool workers;
+
+#endif